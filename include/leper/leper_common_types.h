@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <vector>
 #include <string>
 
@@ -9,6 +11,24 @@
 
 namespace leper {
 
+    // Index into a handle pool plus the generation of the slot when it was handed out
+    // A generation of 0 is never alive, so default handles are invalid
+    template <typename Tag>
+    struct Handle {
+        uint32_t index = std::numeric_limits<uint32_t>::max();
+        uint32_t generation = 0;
+
+        bool is_valid() const { return generation != 0; }
+        bool operator==(const Handle&) const = default;
+    };
+
+    struct MeshTag;
+    struct ShaderTag;
+    struct TextureTag;
+    using MeshHandle = Handle<MeshTag>;
+    using ShaderHandle = Handle<ShaderTag>;
+    using TextureHandle = Handle<TextureTag>;
+
     struct Vertex {
         glm::vec3 position;
         float_t uv_1;
@@ -16,10 +36,20 @@ namespace leper {
         float_t uv_2;
     };
 
+    // Axis aligned bounding box, empty (min > max) by default
+    struct AABB {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float_t>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float_t>::lowest());
+    };
+
     struct Mesh {
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
         std::string name;
+        // Object space bounds of the vertices
+        AABB bounds = {};
+        // Set once the mesh is uploaded to the renderer
+        MeshHandle handle = {};
     };
 
     struct IMaterial {};
@@ -15,6 +15,10 @@ namespace leper {
         glm::mat4 model = glm::identity<glm::mat4>();
 
         bool is_dirty = false;
+        // Bumped every time the model matrix is recomputed, lets systems catch up on changes
+        uint32_t version = 0;
+        // Expected to stay in place, its shadow is cached until it moves
+        bool is_static = false;
     };
 
     struct CameraComponent {
@@ -28,10 +32,20 @@ namespace leper {
         glm::vec3 direction = glm::vec3(0.0f, 1.0f, 0.0f);
     };
 
+    // Box hiding what is behind it in the software occlusion pass. Object space,
+    // and it must stay inside the visible geometry of the entity
+    struct OccluderComponent {
+        AABB bounds = {};
+    };
+
+    // Tag for entities that can be tamed or fought
+    struct CreatureComponent {};
+
     struct PointLightComponent {
         glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
         float_t intensity = 1.0;
-        // float_t range = 10.0;
+        // Distance where the light fades out, also bounds it for clustering
+        float_t range = 5.0f;
         // PointLightFallof falloff = PointLightFallof::Medium;
     };
 
@@ -3,14 +3,87 @@
 #include <cstdint>
 #include <cstddef>
 
+#include "leper/leper_ecs_types.h"
+
 namespace leper {
 
+    // Internal resolution at a render scale of 1, the main target can be resized at runtime
     constexpr uint16_t MAIN_FRAME_WIDTH = 480u;
     constexpr uint16_t MAIN_FRAME_HEIGHT = 270u;
+    // Render scale range, relative to MAIN_FRAME_WIDTH x MAIN_FRAME_HEIGHT
+    constexpr float MIN_RENDER_SCALE = 0.5f;
+    constexpr float MAX_RENDER_SCALE = 4.0f;
+    // Main target widths are multiples of this, the software rasterizer's tile width
+    constexpr uint16_t MAIN_FRAME_WIDTH_ALIGNMENT = 32u;
+
+    // Point lights uploaded per frame, only each fragment's cluster list is shaded
+    constexpr size_t MAX_POINT_LIGHTS = 256;
+
+    // Froxel grid of the clustered lighting: screen tiles by logarithmic depth slices
+    constexpr uint32_t LIGHT_CLUSTER_GRID_X = 16;
+    constexpr uint32_t LIGHT_CLUSTER_GRID_Y = 9;
+    constexpr uint32_t LIGHT_CLUSTER_GRID_Z = 24;
+    constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 64;
+    // Light indices of all clusters together
+    constexpr uint32_t LIGHT_CLUSTER_INDEX_CAPACITY = 32 * 1024;
+
+    // Cascades of the directional light, each in its own layer of the shadow map array
+    constexpr uint32_t SHADOW_CASCADE_COUNT = 3;
+    // Per layer, the cascades keep the texel budget of a single 2048x2048 map
+    constexpr uint16_t SHADOW_MAP_WIDTH = 1024;
+    constexpr uint16_t SHADOW_MAP_HEIGHT = 1024;
+
+    // Blend of the practical split scheme, 1 is fully logarithmic and 0 fully uniform
+    constexpr float SHADOW_CASCADE_SPLIT_LAMBDA = 0.75f;
+
+    // World units the shadow footprint and depth range are rounded to, and extra depth around casters
+    constexpr float SHADOW_EXTENT_QUANTUM = 1.0f;
+    constexpr float SHADOW_DEPTH_MARGIN = 0.5f;
+    // Depth kept towards the light beyond the static casters, dynamic casters further out are clipped
+    // so they never move the light matrix the static shadows are cached with
+    constexpr float SHADOW_DYNAMIC_CASTER_MARGIN = 4.0f;
+
+    // One command per entity and pass, static casters only go in one of the two shadow passes of a cascade
+    constexpr size_t MAX_RENDER_COMMANDS = (SHADOW_CASCADE_COUNT + 1) * MAX_ENTITIES;
+
+    // Cursor trail samples kept, enough for a high rate mouse over a whole lifetime
+    constexpr size_t MAX_TRAIL_SAMPLES = 2048;
+    // Seconds a trail sample takes to fade out
+    constexpr float TRAIL_LIFETIME = 0.35f;
+    // Screen pixels from the trail's center line to its edge at the newest sample
+    constexpr float TRAIL_HALF_WIDTH = 2.5f;
+
+    // Packets queued to the render thread before the game thread waits for it
+    constexpr size_t RENDER_THREAD_QUEUE_DEPTH = 2;
+
+    // Bytes of per frame streamed data: instances, uniform blocks, light clusters and the trail
+    constexpr size_t STREAM_BUFFER_FRAME_SIZE = 1024 * 1024;
+
+    // Uniform buffer bindings of FrameUniforms and ShadowPassUniforms, fixed by the layout in frame.glsl
+    constexpr uint32_t FRAME_UNIFORMS_BINDING = 0;
+    constexpr uint32_t SHADOW_PASS_UNIFORMS_BINDING = 1;
+
+    // Shader storage bindings of the clustered lighting, fixed by lights.glsl
+    constexpr uint32_t POINT_LIGHTS_BINDING = 2;
+    constexpr uint32_t LIGHT_CLUSTERS_BINDING = 3;
+    constexpr uint32_t LIGHT_INDICES_BINDING = 4;
+
+    // Shared storage of every static mesh
+    constexpr uint32_t MESH_ARENA_VERTEX_CAPACITY = 256 * 1024;
+    constexpr uint32_t MESH_ARENA_INDEX_CAPACITY = 1024 * 1024;
+
+    // Vertex buffer binding of the streamed instances in the mesh arena VAO
+    constexpr uint32_t INSTANCE_BINDING = 1;
+
+    // Vertex attribute locations of the per instance data, the model matrix takes 4
+    constexpr uint32_t INSTANCE_MODEL_LOCATION = 2;
+    constexpr uint32_t INSTANCE_COLOR_LOCATION = 6;
 
-    constexpr size_t MAX_POINT_LIGHTS = 3;
+    // CPU depth buffer of the occlusion culling pass
+    constexpr uint16_t OCCLUSION_BUFFER_WIDTH = 256u;
+    constexpr uint16_t OCCLUSION_BUFFER_HEIGHT = 144u;
 
-    constexpr uint16_t SHADOW_MAP_WIDTH = 2048;
-    constexpr uint16_t SHADOW_MAP_HEIGHT = 2048;
+    // Leaves of the scene BVH that may be reinserted each frame
+    constexpr size_t BVH_REINSERTIONS_PER_FRAME = 32;
 
 } // namespace leper
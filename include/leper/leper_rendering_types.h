@@ -7,9 +7,41 @@ namespace leper {
 
     using MaterialId = uint8_t;
 
+    // Where a mesh lives inside the renderer's mesh arena, in elements rather than bytes
+    struct MeshRange {
+        uint32_t first_index = 0;
+        uint32_t index_count = 0;
+        uint32_t first_vertex = 0;
+        uint32_t vertex_count = 0;
+    };
+
+    // Layout expected by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    // Per frame memory handed out by a render device
+    struct StreamAllocation {
+        // Write only, may point into mapped GPU memory
+        void* data = nullptr;
+        // From the start of the device's stream buffer
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+
+        bool is_valid() const { return data != nullptr; }
+    };
+
     struct MeshGlObjetcs {
-        GLuint vao;
-        GLuint ebo;
+        MeshRange range;
+    };
+
+    struct TextureGlObjects {
+        GLuint texture;
+        GLenum target;
     };
 
 } // namespace leper
@@ -1,11 +1,11 @@
 #version 460 core
 
-layout (location = 0) in vec3 aPos;
+#include "frame.glsl"
 
-uniform mat4 lightMatrix;
-uniform mat4 model;
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in mat4 aModel;
 
 void main()
 {
-    gl_Position = lightMatrix * model * vec4(aPos, 1.0);
+    gl_Position = cascadeMatrices[shadowCascade] * aModel * vec4(aPos, 1.0);
 }
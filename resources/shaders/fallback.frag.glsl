@@ -0,0 +1,10 @@
+#version 460 core
+
+// Drawn while the material programs build, unlit albedo
+in vec3 vColor;
+
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(vColor, 1.0);
+}
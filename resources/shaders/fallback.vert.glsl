@@ -0,0 +1,15 @@
+#version 460 core
+
+#include "frame.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in vec4 aColor;
+
+out vec3 vColor;
+
+void main()
+{
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+    vColor = aColor.rgb;
+}
@@ -0,0 +1,24 @@
+// Mirrors FrameUniforms in src/renderer/frame_uniforms.h
+
+#define SHADOW_CASCADE_COUNT 3
+
+struct DirLight {
+    vec3 dir;
+    float intensity;
+    vec3 col;
+};
+
+layout (std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+    vec3 viewPos;
+    DirLight dirLight;
+    vec4 clusterParams;
+};
+
+// Only bound during the shadow passes
+layout (std140, binding = 1) uniform ShadowPass {
+    uint shadowCascade;
+};
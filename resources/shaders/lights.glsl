@@ -0,0 +1,35 @@
+// Mirrors GpuPointLight in src/renderer/frame_uniforms.h and LightClusters
+// in src/renderer/lighting/light_clusters.h
+
+#define LIGHT_CLUSTER_GRID_X 16
+#define LIGHT_CLUSTER_GRID_Y 9
+#define LIGHT_CLUSTER_GRID_Z 24
+
+struct PointLight {
+    vec3 pos;
+    float intensity;
+    vec3 col;
+    float range;
+    float falloff;
+};
+
+layout (std430, binding = 2) readonly buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Offset and count of each cluster's run in lightIndices
+layout (std430, binding = 3) readonly buffer LightClusters {
+    uvec2 lightClusters[];
+};
+
+layout (std430, binding = 4) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+// Cluster of a fragment from its window position and view depth, see clusterParams
+uint getLightCluster(vec2 fragCoord, float viewDepth) {
+    uvec2 tile = min(uvec2(fragCoord * clusterParams.xy), uvec2(LIGHT_CLUSTER_GRID_X - 1, LIGHT_CLUSTER_GRID_Y - 1));
+    float slice = log(max(viewDepth, 1e-4)) * clusterParams.z + clusterParams.w;
+    uint z = uint(clamp(slice, 0.0, float(LIGHT_CLUSTER_GRID_Z - 1)));
+    return (z * LIGHT_CLUSTER_GRID_Y + tile.y) * LIGHT_CLUSTER_GRID_X + tile.x;
+}
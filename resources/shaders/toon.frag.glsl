@@ -1,40 +1,34 @@
 #version 460 core
 
-#define MAX_POINT_LIGHTS 3
+#include "frame.glsl"
+#include "lights.glsl"
+
 #define N_COLORS_POINT 5.0
 
 in vec3 vNorm;
 in vec3 vPos;
-in vec4 vPosLightSpace;
-
-uniform vec3 viewPos;
-uniform sampler2D shadowMap;
-
-struct DirLight {
-    vec3 dir;
-    float intensity;
-    vec3 col;
-};
-struct PointLight {    
-    vec3 pos;
-    float intensity;
-    vec3 col;
-    float range;
-    float falloff;
-};  
-
-uniform DirLight dirLight;
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
+in vec3 vColor;
 
-uniform vec3 u_color;
+// Texture unit 0, bound by the main pass
+layout (binding = 0) uniform sampler2DArray shadowMap;
 
 out vec4 FragColor;
 
-float calcShadow()
+float calcShadow(float viewDepth)
 {
-    vec3 projCoords = vPosLightSpace.xyz / vPosLightSpace.w;
+    // First cascade reaching past the fragment, the last one covers the rest
+    int cascade = SHADOW_CASCADE_COUNT - 1;
+    for (int i = 0; i < SHADOW_CASCADE_COUNT - 1; i++) {
+        if (viewDepth < cascadeSplits[i]) {
+            cascade = i;
+            break;
+        }
+    }
+
+    vec4 posLightSpace = cascadeMatrices[cascade] * vec4(vPos, 1.0);
+    vec3 projCoords = posLightSpace.xyz / posLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5; 
-    float closestDepth = texture(shadowMap, projCoords.xy).r;   
+    float closestDepth = texture(shadowMap, vec3(projCoords.xy, cascade)).r;   
     float currentDepth = projCoords.z;  
 
     float bias = 0.005;
@@ -44,7 +38,7 @@ float calcShadow()
 }
 
 
-vec3 calcDirLight(DirLight light, vec3 N, vec3 V) {
+vec3 calcDirLight(DirLight light, vec3 N, vec3 V, float viewDepth) {
     vec3 L = normalize(light.dir);
     vec3 H = normalize(V + L);
 
@@ -64,9 +58,9 @@ vec3 calcDirLight(DirLight light, vec3 N, vec3 V) {
     vec3 specularCol = light.col * specular * light.intensity;
     vec3 rimCol = light.col * vec3(rimIntensity);
 
-    float shadow = calcShadow();
+    float shadow = calcShadow(viewDepth);
 
-    return ((diffuseCol + specularCol + rimCol) * (1.0 - shadow)) * u_color;
+    return ((diffuseCol + specularCol + rimCol) * (1.0 - shadow)) * vColor;
 }
 
 vec3 calcPointLight(PointLight light, vec3 pos, vec3 N) {
@@ -77,19 +71,26 @@ vec3 calcPointLight(PointLight light, vec3 pos, vec3 N) {
 
     float distance = length(light.pos - pos);
     float attenuation = 1.0 / (1.0 + distance * distance);
+    // Fades to zero at the range so the light never pops at its cluster bounds
+    float window = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
 
-    return light.col * light.intensity * u_color * attenuation * nDotL;
+    return light.col * light.intensity * vColor * attenuation * nDotL;
 }
 
 void main()
 {
     vec3 viewDir = normalize(viewPos - vPos);
+    float viewDepth = -(view * vec4(vPos, 1.0)).z;
 
     vec3 col = vec3(0.0);
-    col += 0.3 * u_color;
-    col += calcDirLight(dirLight, vNorm, viewDir);
-    for(int i = 0; i < MAX_POINT_LIGHTS; i++) {
-        col += calcPointLight(pointLights[i], vPos, vNorm);
+    col += 0.3 * vColor;
+    col += calcDirLight(dirLight, vNorm, viewDir, viewDepth);
+
+    // Only the lights touching this fragment's cluster
+    uvec2 cluster = lightClusters[getLightCluster(gl_FragCoord.xy, viewDepth)];
+    for(uint i = 0; i < cluster.y; i++) {
+        col += calcPointLight(pointLights[lightIndices[cluster.x + i]], vPos, vNorm);
     }
 
     FragColor = vec4(col, 1.0);
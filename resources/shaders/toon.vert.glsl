@@ -1,35 +1,21 @@
 #version 460 core
 
+#include "frame.glsl"
+
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNorm;
-
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 lightMatrix;
-
-struct Light {
-    vec3 sunDir;
-    vec3 sunColor;
-
-    vec3 pointPos;
-    float constant;
-    vec3 pointColor;
-    float linear;
-    float quadratic;
-};
-uniform Light light;
-
-uniform mat4 model;
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in vec4 aColor;
 
 out vec3 vNorm;
 out vec3 vPos;
-out vec4 vPosLightSpace;
+out vec3 vColor;
 
 
 void main()
 {
-    vPos = vec3(model * vec4(aPos, 1.0));
+    vPos = vec3(aModel * vec4(aPos, 1.0));
     gl_Position = projection * view * vec4(vPos, 1.0);
-    vNorm = normalize(mat3(transpose(inverse(model))) * aNorm);
-    vPosLightSpace = lightMatrix * vec4(vPos, 1.0);
+    vNorm = normalize(mat3(transpose(inverse(aModel))) * aNorm);
+    vColor = aColor.rgb;
 }
@@ -1,7 +1,9 @@
 #version 460 core
 
+in float vAlpha;
+
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+    FragColor = vec4(1.0, 1.0, 1.0, vAlpha);
 }
@@ -1,7 +1,11 @@
 #version 460 core
 
 layout (location = 0) in vec2 aPos;
+layout (location = 1) in float aAlpha;
+
+out float vAlpha;
 
 void main() {
+    vAlpha = aAlpha;
     gl_Position = vec4(aPos, 0.0, 1.0);
 }
@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <fstream>
 #include <optional>
+#include <unordered_map>
 #include <spdlog/spdlog.h>
 #include <vector>
 
@@ -25,10 +26,6 @@ namespace leper {
         return out;
     }
 
-    std::vector<uint32_t> build_indices_from_vertices(const std::vector<Vertex>& vertices) {
-        return {};
-    }
-
     // S/o https://www.opengl-tutorial.org/beginners-tutorials/tutorial-7-model-loading/
     // for the tutorial
     std::optional<Mesh> load_obj_mesh(const std::string& file_name) {
@@ -105,12 +102,29 @@ namespace leper {
         assert(position_indices.size() == normal_indices.size());
 
         std::vector<Vertex> vertices;
-        vertices.reserve(position_indices.size());
+        std::vector<uint32_t> indices;
+        indices.reserve(position_indices.size());
+
+        // Face corners sharing a position and a normal become a single indexed vertex
+        std::unordered_map<uint64_t, uint32_t> vertex_indices;
+
+        AABB bounds = {};
+        for (const auto& position : temp_positions) {
+            bounds.min = glm::min(bounds.min, position);
+            bounds.max = glm::max(bounds.max, position);
+        }
 
         for (size_t i = 0; i < position_indices.size(); i++) {
             assert(position_indices[i] > 0 && position_indices[i] <= temp_positions.size());
             assert(normal_indices[i] > 0 && normal_indices[i] <= temp_normals.size());
 
+            const uint64_t key = (static_cast<uint64_t>(position_indices[i]) << 32) | normal_indices[i];
+            const auto [it, inserted] = vertex_indices.try_emplace(key, static_cast<uint32_t>(vertices.size()));
+            indices.push_back(it->second);
+            if (!inserted) {
+                continue;
+            }
+
             Vertex vertex;
             // We substract by 1 because obj are 1 index based and C++ is 0
             vertex.position = temp_positions[position_indices[i] - 1];
@@ -122,8 +136,9 @@ namespace leper {
 
         return Mesh{
             .vertices = vertices,
-            .indices = build_indices_from_vertices(vertices),
-            .name = file_name};
+            .indices = indices,
+            .name = file_name,
+            .bounds = bounds};
     }
 
 } // namespace leper
@@ -0,0 +1,291 @@
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "../math/bounds.h"
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace leper {
+
+    constexpr uint16_t TILE_WIDTH = 32;
+    constexpr uint16_t TILE_HEIGHT = 16;
+    constexpr size_t VISIBILITY_GRAIN = 256;
+
+    // Two triangles per face of the box, corners indexed as in get_corners()
+    constexpr std::array<std::array<uint8_t, 3>, 12> BOX_TRIANGLES = {{
+        {0, 2, 1}, {1, 2, 3}, // -Z
+        {4, 5, 6}, {5, 7, 6}, // +Z
+        {0, 1, 4}, {1, 5, 4}, // -Y
+        {2, 6, 3}, {3, 6, 7}, // +Y
+        {0, 4, 2}, {2, 4, 6}, // -X
+        {1, 3, 5}, {3, 7, 5}, // +X
+    }};
+
+    OcclusionCuller::OcclusionCuller(uint16_t width, uint16_t height)
+        : width_(width), height_(height),
+          tiles_x_((width + TILE_WIDTH - 1) / TILE_WIDTH),
+          tiles_y_((height + TILE_HEIGHT - 1) / TILE_HEIGHT) {
+        assert(width % TILE_WIDTH == 0 && "Occlusion buffer width must be a multiple of the tile width");
+
+        tile_bins_.resize(tiles_x_ * tiles_y_);
+
+        glm::ivec2 size = glm::ivec2(width, height);
+        while (true) {
+            level_sizes_.push_back(size);
+            levels_.emplace_back(size.x * size.y, 1.0f);
+            if (size.x == 1 && size.y == 1) {
+                break;
+            }
+            size = glm::max((size + glm::ivec2(1)) / 2, glm::ivec2(1));
+        }
+    }
+
+    void OcclusionCuller::begin_frame(const glm::mat4& view_projection) {
+        view_projection_ = view_projection;
+        triangles_.clear();
+        for (auto& bin : tile_bins_) {
+            bin.clear();
+        }
+    }
+
+    void OcclusionCuller::add_occluder(const AABB& local_bounds, const glm::mat4& model) {
+        const glm::mat4 model_view_projection = view_projection_ * model;
+        const std::array<glm::vec3, 8> corners = get_corners(local_bounds);
+
+        std::array<glm::vec4, 8> clip;
+        for (size_t i = 0; i < corners.size(); i++) {
+            clip[i] = model_view_projection * glm::vec4(corners[i], 1.0f);
+            // Crossing the near plane would need clipping, dropping the occluder is conservative
+            if (clip[i].w <= 1e-5f || clip[i].z < -clip[i].w) {
+                return;
+            }
+        }
+
+        for (const auto& triangle : BOX_TRIANGLES) {
+            add_triangle(clip[triangle[0]], clip[triangle[1]], clip[triangle[2]]);
+        }
+    }
+
+    void OcclusionCuller::add_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        auto to_screen = [&](const glm::vec4& clip) {
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            return glm::vec3((ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_, ndc.z * 0.5f + 0.5f);
+        };
+
+        ScreenTriangle triangle = {.vertices = {to_screen(a), to_screen(b), to_screen(c)}};
+        auto& v = triangle.vertices;
+
+        const float_t area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::abs(area) < 1e-6f) {
+            return;
+        }
+        // Both sides are drawn, make them all counter clockwise
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+        }
+
+        const glm::vec2 min = glm::min(glm::vec2(v[0]), glm::min(glm::vec2(v[1]), glm::vec2(v[2])));
+        const glm::vec2 max = glm::max(glm::vec2(v[0]), glm::max(glm::vec2(v[1]), glm::vec2(v[2])));
+        triangle.min_pixel = glm::max(glm::ivec2(glm::floor(min)), glm::ivec2(0));
+        triangle.max_pixel = glm::min(glm::ivec2(glm::floor(max)), glm::ivec2(width_ - 1, height_ - 1));
+        if (triangle.min_pixel.x > triangle.max_pixel.x || triangle.min_pixel.y > triangle.max_pixel.y) {
+            return;
+        }
+
+        const uint32_t index = static_cast<uint32_t>(triangles_.size());
+        triangles_.push_back(triangle);
+
+        for (int32_t ty = triangle.min_pixel.y / TILE_HEIGHT; ty <= triangle.max_pixel.y / TILE_HEIGHT; ty++) {
+            for (int32_t tx = triangle.min_pixel.x / TILE_WIDTH; tx <= triangle.max_pixel.x / TILE_WIDTH; tx++) {
+                tile_bins_[ty * tiles_x_ + tx].push_back(index);
+            }
+        }
+    }
+
+    void OcclusionCuller::rasterize(ThreadPool* pool) {
+        const size_t tile_count = tile_bins_.size();
+        if (pool) {
+            pool->parallel_for(tile_count, 1, [this](size_t begin, size_t end) {
+                for (size_t tile = begin; tile < end; tile++) {
+                    rasterize_tile(tile);
+                }
+            });
+        } else {
+            for (size_t tile = 0; tile < tile_count; tile++) {
+                rasterize_tile(tile);
+            }
+        }
+
+        build_pyramid();
+    }
+
+    void OcclusionCuller::rasterize_tile(size_t tile) {
+        const int32_t tile_x0 = static_cast<int32_t>(tile % tiles_x_) * TILE_WIDTH;
+        const int32_t tile_y0 = static_cast<int32_t>(tile / tiles_x_) * TILE_HEIGHT;
+        const int32_t tile_x1 = std::min<int32_t>(tile_x0 + TILE_WIDTH, width_);
+        const int32_t tile_y1 = std::min<int32_t>(tile_y0 + TILE_HEIGHT, height_);
+
+        std::vector<float_t>& depth = levels_[0];
+        for (int32_t y = tile_y0; y < tile_y1; y++) {
+            std::fill(depth.begin() + y * width_ + tile_x0, depth.begin() + y * width_ + tile_x1, 1.0f);
+        }
+
+        for (auto index : tile_bins_[tile]) {
+            const ScreenTriangle& triangle = triangles_[index];
+            const auto& v = triangle.vertices;
+
+            // Edge functions E(x, y) = a * x + b * y + c, positive inside
+            float_t edge_a[3], edge_b[3], edge_c[3];
+            for (int e = 0; e < 3; e++) {
+                const glm::vec3& p = v[e];
+                const glm::vec3& q = v[(e + 1) % 3];
+                edge_a[e] = p.y - q.y;
+                edge_b[e] = q.x - p.x;
+                edge_c[e] = (q.y - p.y) * p.x - (q.x - p.x) * p.y;
+            }
+
+            // Depth plane z = z_dx * x + z_dy * y + z_0
+            const float_t area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+            const float_t z_dx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+            const float_t z_dy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+            const float_t z_0 = v[0].z - z_dx * v[0].x - z_dy * v[0].y;
+
+            // Groups of 4 pixels stay inside the tile since tiles are 4 aligned
+            const int32_t x0 = std::max(triangle.min_pixel.x, tile_x0) & ~3;
+            const int32_t x1 = std::min(triangle.max_pixel.x + 1, tile_x1);
+            const int32_t y0 = std::max(triangle.min_pixel.y, tile_y0);
+            const int32_t y1 = std::min(triangle.max_pixel.y + 1, tile_y1);
+
+            for (int32_t y = y0; y < y1; y++) {
+                const float_t py = static_cast<float_t>(y) + 0.5f;
+                float_t* row = depth.data() + y * width_;
+
+#if defined(__SSE2__)
+                const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 row_edge[3], step_edge[3];
+                for (int e = 0; e < 3; e++) {
+                    row_edge[e] = _mm_set1_ps(edge_b[e] * py + edge_c[e]);
+                    step_edge[e] = _mm_set1_ps(edge_a[e]);
+                }
+                const __m128 row_z = _mm_set1_ps(z_dy * py + z_0);
+                const __m128 step_z = _mm_set1_ps(z_dx);
+                const __m128 zero = _mm_setzero_ps();
+
+                for (int32_t x = x0; x < x1; x += 4) {
+                    const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float_t>(x)), offsets);
+
+                    __m128 mask = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(step_edge[0], px), row_edge[0]), zero);
+                    mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(step_edge[1], px), row_edge[1]), zero));
+                    mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(step_edge[2], px), row_edge[2]), zero));
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+
+                    const __m128 z = _mm_add_ps(_mm_mul_ps(step_z, px), row_z);
+                    const __m128 current = _mm_loadu_ps(row + x);
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, current));
+
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, current)));
+                }
+#else
+                for (int32_t x = x0; x < x1; x++) {
+                    const float_t px = static_cast<float_t>(x) + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) {
+                        inside &= edge_a[e] * px + edge_b[e] * py + edge_c[e] >= 0.0f;
+                    }
+                    const float_t z = z_dx * px + z_dy * py + z_0;
+                    if (inside && z < row[x]) {
+                        row[x] = z;
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    // Each texel keeps the farthest depth of the 2x2 texels below it
+    void OcclusionCuller::build_pyramid() {
+        for (size_t level = 1; level < levels_.size(); level++) {
+            const glm::ivec2 src_size = level_sizes_[level - 1];
+            const glm::ivec2 dst_size = level_sizes_[level];
+            const std::vector<float_t>& src = levels_[level - 1];
+            std::vector<float_t>& dst = levels_[level];
+
+            for (int32_t y = 0; y < dst_size.y; y++) {
+                const int32_t y0 = 2 * y;
+                const int32_t y1 = std::min(2 * y + 1, src_size.y - 1);
+                for (int32_t x = 0; x < dst_size.x; x++) {
+                    const int32_t x0 = 2 * x;
+                    const int32_t x1 = std::min(2 * x + 1, src_size.x - 1);
+                    dst[y * dst_size.x + x] = std::max(std::max(src[y0 * src_size.x + x0], src[y0 * src_size.x + x1]),
+                                                       std::max(src[y1 * src_size.x + x0], src[y1 * src_size.x + x1]));
+                }
+            }
+        }
+    }
+
+    bool OcclusionCuller::is_visible(const AABB& world_bounds) const {
+        glm::vec2 min = glm::vec2(std::numeric_limits<float_t>::max());
+        glm::vec2 max = glm::vec2(std::numeric_limits<float_t>::lowest());
+        float_t min_depth = std::numeric_limits<float_t>::max();
+
+        for (const auto& corner : get_corners(world_bounds)) {
+            const glm::vec4 clip = view_projection_ * glm::vec4(corner, 1.0f);
+            // Touches the near plane: it covers most of the screen anyway
+            if (clip.w <= 1e-5f || clip.z < -clip.w) {
+                return true;
+            }
+
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            const glm::vec2 screen = glm::vec2((ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_);
+            min = glm::min(min, screen);
+            max = glm::max(max, screen);
+            min_depth = std::min(min_depth, ndc.z * 0.5f + 0.5f);
+        }
+
+        const glm::ivec2 min_pixel = glm::max(glm::ivec2(glm::floor(min)), glm::ivec2(0));
+        const glm::ivec2 max_pixel = glm::min(glm::ivec2(glm::floor(max)), glm::ivec2(width_ - 1, height_ - 1));
+        if (min_pixel.x > max_pixel.x || min_pixel.y > max_pixel.y) {
+            return false;
+        }
+
+        // Coarsest level where the rectangle spans at most 2 texels on each axis
+        const int32_t extent = std::max(max_pixel.x - min_pixel.x, max_pixel.y - min_pixel.y) + 1;
+        size_t level = 0;
+        while ((1 << level) < extent && level + 1 < levels_.size()) {
+            level++;
+        }
+
+        const glm::ivec2 size = level_sizes_[level];
+        const std::vector<float_t>& depth = levels_[level];
+        float_t max_depth = 0.0f;
+        for (int32_t y = min_pixel.y >> level; y <= (max_pixel.y >> level); y++) {
+            for (int32_t x = min_pixel.x >> level; x <= (max_pixel.x >> level); x++) {
+                max_depth = std::max(max_depth, depth[std::min(y, size.y - 1) * size.x + std::min(x, size.x - 1)]);
+            }
+        }
+
+        return min_depth <= max_depth;
+    }
+
+    void OcclusionCuller::test_visibility(const AABB* world_bounds, size_t count, uint8_t* visible, ThreadPool* pool) const {
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                visible[i] = is_visible(world_bounds[i]);
+            }
+        };
+
+        if (pool) {
+            pool->parallel_for(count, VISIBILITY_GRAIN, run);
+        } else {
+            run(0, count);
+        }
+    }
+
+} // namespace leper
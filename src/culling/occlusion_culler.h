@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "../utils/thread_pool.h"
+
+namespace leper {
+
+    // CPU-only occlusion culling: occluder proxies are rasterized into a small depth
+    // buffer, reduced into a hierarchical-Z pyramid of farthest depths, and object
+    // bounds are tested against the pyramid before anything is sent to the GPU.
+    //
+    // Occluder proxies must sit fully inside the geometry they stand for, otherwise
+    // objects peeking past the real silhouette would be culled.
+    class OcclusionCuller {
+      public:
+        // Width must be a multiple of the tile width
+        OcclusionCuller(uint16_t width, uint16_t height);
+
+        void begin_frame(const glm::mat4& view_projection);
+        // Oriented box: the local box transformed by `model`
+        void add_occluder(const AABB& local_bounds, const glm::mat4& model);
+        // Rasterizes the occluders tile by tile and builds the pyramid
+        void rasterize(ThreadPool* pool = nullptr);
+
+        bool is_visible(const AABB& world_bounds) const;
+        void test_visibility(const AABB* world_bounds, size_t count, uint8_t* visible, ThreadPool* pool = nullptr) const;
+
+        uint16_t get_width() const { return width_; }
+        uint16_t get_height() const { return height_; }
+        // Depth in [0, 1], 1 being the far plane. Level 0 is the rasterized buffer
+        const std::vector<float_t>& get_depth_level(size_t level) const { return levels_[level]; }
+        size_t get_level_count() const { return levels_.size(); }
+
+      private:
+        struct ScreenTriangle {
+            // Pixel coordinates and [0, 1] depth
+            std::array<glm::vec3, 3> vertices;
+            glm::ivec2 min_pixel;
+            glm::ivec2 max_pixel;
+        };
+
+        void add_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        void rasterize_tile(size_t tile);
+        void build_pyramid();
+
+        uint16_t width_;
+        uint16_t height_;
+        uint16_t tiles_x_;
+        uint16_t tiles_y_;
+        glm::mat4 view_projection_ = glm::mat4(1.0f);
+
+        std::vector<ScreenTriangle> triangles_;
+        std::vector<std::vector<uint32_t>> tile_bins_;
+
+        // Level i is (width >> i) x (height >> i), rounded up
+        std::vector<std::vector<float_t>> levels_;
+        std::vector<glm::ivec2> level_sizes_;
+    };
+
+} // namespace leper
@@ -57,7 +57,8 @@ namespace leper {
 
         T& get(Entity entity) {
             assert(has(entity) && "Retrieving non-existant component data");
-            return data_[entity_to_index_[entity]];
+            // at() rather than [] so concurrent readers are safe
+            return data_[entity_to_index_.at(entity)];
         }
 
         std::array<T, MAX_ENTITIES>& data() {
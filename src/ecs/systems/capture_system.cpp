@@ -0,0 +1,75 @@
+#include "capture_system.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "leper/leper_ecs_components.h"
+
+namespace leper {
+
+    constexpr float_t CAPTURE_GRID_CELL_SIZE = 32.0f;
+    constexpr uint32_t MAX_CAPTURE_TRAIL_POINTS = 1024;
+
+    CaptureSystem::CaptureSystem(ECS* ecs) : ecs_(ecs), detector_(CAPTURE_GRID_CELL_SIZE, MAX_CAPTURE_TRAIL_POINTS) {
+        pending_vertices_.reserve(MAX_CAPTURE_TRAIL_POINTS);
+        loop_.reserve(MAX_CAPTURE_TRAIL_POINTS);
+    }
+
+    void CaptureSystem::add_cursor_point(const glm::vec2& point) {
+        if (detector_.add_point(point)) {
+            const auto& loop = detector_.get_loop();
+            pending_vertices_.insert(pending_vertices_.end(), loop.begin(), loop.end());
+            pending_loop_sizes_.push_back(static_cast<uint32_t>(loop.size()));
+        }
+    }
+
+    void CaptureSystem::update(Entity camera, uint16_t width, uint16_t height) {
+        captured_.clear();
+        if (pending_loop_sizes_.empty()) {
+            return;
+        }
+
+        // Project every creature once for all the loops
+        const CameraComponent& camera_data = ecs_->get_component<CameraComponent>(camera);
+        const glm::mat4 view_projection = camera_data.projection * camera_data.view;
+
+        creatures_.clear();
+        screen_positions_.clear();
+        for (auto entity : ecs_->get_entities_with_components<CreatureComponent, TransformComponent>()) {
+            const glm::mat4& model = ecs_->get_component<TransformComponent>(entity).model;
+            const glm::vec4 clip = view_projection * model[3];
+            if (clip.w <= 0.0f) {
+                continue;
+            }
+
+            // Same convention as the cursor: pixels with Y going down
+            const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            creatures_.push_back(entity);
+            screen_positions_.push_back({(ndc.x * 0.5f + 0.5f) * width, (0.5f - ndc.y * 0.5f) * height});
+        }
+
+        inside_.resize(creatures_.size());
+        is_captured_.assign(creatures_.size(), 0);
+
+        size_t first_vertex = 0;
+        for (auto loop_size : pending_loop_sizes_) {
+            loop_.assign(pending_vertices_.begin() + first_vertex, pending_vertices_.begin() + first_vertex + loop_size);
+            first_vertex += loop_size;
+
+            points_in_polygon(loop_, screen_positions_.data(), screen_positions_.size(), inside_.data());
+            for (size_t i = 0; i < creatures_.size(); i++) {
+                is_captured_[i] |= inside_[i];
+            }
+        }
+        pending_vertices_.clear();
+        pending_loop_sizes_.clear();
+
+        for (size_t i = 0; i < creatures_.size(); i++) {
+            if (is_captured_[i]) {
+                captured_.push_back(creatures_[i]);
+                spdlog::info("Creature {} captured", creatures_[i]);
+            }
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_ecs_types.h"
+#include "../ecs.h"
+#include "../../gameplay/capture_loop.h"
+
+namespace leper {
+
+    // Feeds the cursor trail to a CaptureLoopDetector and tests the creatures on
+    // screen against the loops it closes
+    class CaptureSystem {
+      public:
+        explicit CaptureSystem(ECS* ecs);
+
+        // Cursor position in framebuffer pixels, y down, can be called at the mouse rate
+        void add_cursor_point(const glm::vec2& point);
+        // Tests the creatures against the loops closed since the last update, projected on the framebuffer
+        void update(Entity camera, uint16_t width, uint16_t height);
+
+        // Creatures caught by the last update
+        const std::vector<Entity>& get_captured() const { return captured_; }
+
+      private:
+        ECS* ecs_;
+        CaptureLoopDetector detector_;
+
+        // Loops closed since the last update, stored back to back
+        std::vector<glm::vec2> pending_vertices_;
+        std::vector<uint32_t> pending_loop_sizes_;
+
+        std::vector<glm::vec2> loop_;
+        std::vector<Entity> creatures_;
+        std::vector<glm::vec2> screen_positions_;
+        std::vector<uint8_t> inside_;
+        std::vector<uint8_t> is_captured_;
+        std::vector<Entity> captured_;
+    };
+
+} // namespace leper
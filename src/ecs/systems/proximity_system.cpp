@@ -0,0 +1,31 @@
+#include "proximity_system.h"
+
+#include "leper/leper_ecs_components.h"
+
+namespace leper {
+
+    // Close to the usual query radius so a query touches a handful of cells
+    constexpr float_t PROXIMITY_CELL_SIZE = 2.0f;
+    constexpr uint32_t PROXIMITY_BUCKET_COUNT = 2 * MAX_ENTITIES;
+
+    ProximitySystem::ProximitySystem(ECS* ecs, ThreadPool* pool)
+        : ecs_(ecs), pool_(pool), grid_(PROXIMITY_CELL_SIZE, PROXIMITY_BUCKET_COUNT) {
+        positions_.reserve(MAX_ENTITIES);
+        entities_.reserve(MAX_ENTITIES);
+    }
+
+    void ProximitySystem::update() {
+        positions_.clear();
+        entities_.clear();
+
+        auto creatures = ecs_->get_entities_with_components<CreatureComponent, TransformComponent>();
+        for (auto entity : creatures) {
+            const glm::mat4& model = ecs_->get_component<TransformComponent>(entity).model;
+            positions_.push_back(glm::vec3(model[3]));
+            entities_.push_back(entity);
+        }
+
+        grid_.build(positions_.data(), entities_.data(), positions_.size());
+    }
+
+} // namespace leper
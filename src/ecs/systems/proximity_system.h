@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "leper/leper_ecs_types.h"
+#include "../ecs.h"
+#include "../../spatial/spatial_hash_grid.h"
+#include "../../utils/thread_pool.h"
+
+namespace leper {
+
+    // Rebuilds a spatial hash grid over creature positions every tick, for the
+    // "who is within N meters" queries of gameplay. Must run after TransformSystem::update()
+    class ProximitySystem {
+      public:
+        ProximitySystem(ECS* ecs, ThreadPool* pool);
+        void update();
+
+        const SpatialHashGrid& grid() const { return grid_; }
+        ThreadPool* pool() const { return pool_; }
+
+      private:
+        ECS* ecs_;
+        ThreadPool* pool_;
+        SpatialHashGrid grid_;
+
+        std::vector<glm::vec3> positions_;
+        std::vector<Entity> entities_;
+    };
+
+} // namespace leper
@@ -1,6 +1,7 @@
 #include "rendering_system.h"
 
 #include <algorithm>
+#include <cassert>
 #include <glm/glm.hpp>
 #include <spdlog/spdlog.h>
 #include "glm/ext/matrix_transform.hpp"
@@ -8,6 +9,8 @@
 #include "leper/leper_ecs_components.h"
 #include "leper/leper_ecs_types.h"
 #include "leper/leper_rendering_constants.h"
+#include "../../math/bounds.h"
+#include "../../renderer/shadow/shadow_fitting.h"
 
 glm::vec3 srgb_to_linear(glm::vec3 c) {
     return glm::vec3(
@@ -16,73 +19,267 @@ glm::vec3 srgb_to_linear(glm::vec3 c) {
         pow(c.b, 2.2f));
 }
 
-glm::vec2 screen_to_ndc(double x, double y, uint16_t width, uint16_t height) {
-    return glm::vec2(
-        (x / width) * 2.0 - 1.0,
-        1.0 - (y / height) * 2.0);
-}
-
 namespace leper {
 
-    RenderingSystem::RenderingSystem(ECS* ecs, Renderer* renderer) : ecs_(ecs), renderer_(renderer) {
-        assert(ecs_ && renderer_ && "ECS or Renderer is not set correctly");
+    // splitmix64 finalizer
+    static uint64_t mix_bits(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return value ^ (value >> 31);
+    }
 
-        renderer_->create_shader<ToonMaterial>();
+    // Material shaders are sorted after the depth shader
+    constexpr uint8_t DEPTH_SHADER_SORT_ID = 0;
+    constexpr size_t RENDER_COMMANDS_GRAIN = 256;
+    // Pixels between consecutive trail points
+    constexpr float_t MIN_TRAIL_SEGMENT_LENGTH = 0.5f;
+
+    RenderingSystem::RenderingSystem(ECS* ecs, Renderer* renderer, const SpatialSystem* spatial, ThreadPool* pool)
+        : ecs_(ecs), spatial_(spatial), pool_(pool),
+          occlusion_culler_(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT),
+          mesh_upload_states_(MAX_ENTITIES, MeshUploadState::None) {
+        assert(ecs_ && renderer && spatial_ && pool_ && "ECS, Renderer, SpatialSystem or ThreadPool is not set correctly");
+
+        renderer->create_shader<ToonMaterial>();
+        depth_shader_ = renderer->get_depth_shader();
+        toon_shader_ = renderer->get_material_shader<ToonMaterial>();
     }
 
-    void RenderingSystem::draw_shadow_map_(const glm::mat4& light_matrix) {
-        renderer_->start_shadow_frame();
+    void RenderingSystem::update_mesh_uploads_(RenderPacket& packet) {
+        for (MeshUpload& upload : packet.mesh_uploads) {
+            const Entity entity = upload.owner;
+            if (!ecs_->has_component<MeshComponent>(entity)) {
+                mesh_upload_states_[entity] = MeshUploadState::None;
+                continue;
+            }
+
+            MeshComponent& mesh = ecs_->get_component<MeshComponent>(entity);
+            if (upload.handle.is_valid()) {
+                mesh.handle = upload.handle;
+                mesh_upload_states_[entity] = MeshUploadState::None;
+            } else {
+                spdlog::warn("Mesh {} won't be drawn, its upload failed", mesh.name);
+                mesh.vertices = std::move(upload.mesh.vertices);
+                mesh.indices = std::move(upload.mesh.indices);
+                mesh_upload_states_[entity] = MeshUploadState::Failed;
+            }
+        }
+        packet.mesh_uploads.clear();
+
+        // Entities only share GPU data when they were given an uploaded mesh
+        for (auto entity : ecs_->get_entities_with_components<MeshComponent>()) {
+            MeshComponent& mesh = ecs_->get_component<MeshComponent>(entity);
+            if (!mesh.handle.is_valid() && mesh_upload_states_[entity] == MeshUploadState::None) {
+                mesh_upload_states_[entity] = MeshUploadState::Pending;
+                packet.mesh_uploads.push_back({.owner = entity});
+                packet.mesh_uploads.back().mesh.name = mesh.name;
+                packet.mesh_uploads.back().mesh.vertices = std::move(mesh.vertices);
+                packet.mesh_uploads.back().mesh.indices = std::move(mesh.indices);
+            }
+        }
+    }
 
-        Shader* depth_shader = renderer_->get_depth_shader();
-        depth_shader->bind();
+    uint64_t RenderingSystem::get_casters_signature_(const std::vector<Entity>& casters) const {
+        // Order independent, the tree may return the same casters in another order
+        uint64_t signature = casters.size();
+        for (auto entity : casters) {
+            const uint32_t version = ecs_->get_component<TransformComponent>(entity).version;
+            const MeshHandle mesh = ecs_->get_component<MeshComponent>(entity).handle;
+            signature += mix_bits(static_cast<uint64_t>(entity) << 32 | version) ^ mix_bits(static_cast<uint64_t>(mesh.generation) << 32 | mesh.index);
+        }
+        return signature;
+    }
 
-        depth_shader->set_uniform_mat4f("lightMatrix", light_matrix);
+    void RenderingSystem::queue_draws_(RenderQueue& queue, RenderPass pass, const std::vector<Entity>& entities, ShaderHandle shader,
+                                       uint8_t shader_sort_id, const glm::mat4& view_projection) {
+        auto queue_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const Entity entity = entities[i];
+                const MeshComponent& mesh = ecs_->get_component<MeshComponent>(entity);
+                if (!mesh.handle.is_valid()) {
+                    continue;
+                }
+                const glm::mat4& model = ecs_->get_component<TransformComponent>(entity).model;
+
+                const glm::vec4 clip = view_projection * model[3];
+                const float_t depth = clip.z / clip.w * 0.5f + 0.5f;
+
+                DrawItem item = {.model = model, .color = glm::vec3(1.0f), .mesh = mesh.handle, .shader = shader};
+                if (pass == RenderPass::Main) {
+                    item.color = srgb_to_linear(ecs_->get_component<ToonMaterial>(entity).albedo);
+                }
+
+                queue.push(make_sort_key(pass, shader_sort_id, Renderer::get_mesh_sort_id(mesh.handle), depth), item);
+            }
+        };
+
+        pool_->parallel_for(entities.size(), RENDER_COMMANDS_GRAIN, queue_range);
+    }
 
-        auto mesh_entities = ecs_->get_entities_with_components<MeshComponent, ToonMaterial, TransformComponent>();
-        ComponentArray<MeshComponent>* meshes_array = ecs_->get_component_array<MeshComponent>();
+    void RenderingSystem::build_trail_(TrailPoints& points, uint16_t height, const TrailBuffer& trail, double time) const {
+        points.clear();
+        for (size_t i = 0; i < trail.size(); i++) {
+            const TrailSample& sample = trail[i];
+            const float_t age = static_cast<float_t>(time - sample.time);
+            if (age >= TRAIL_LIFETIME) {
+                continue;
+            }
+
+            // Samples are y down
+            const glm::vec2 position(sample.position.x, height - sample.position.y);
+            if (points.size() > 0) {
+                const glm::vec2 previous(points.x.back(), points.y.back());
+                if (glm::dot(position - previous, position - previous) < MIN_TRAIL_SEGMENT_LENGTH * MIN_TRAIL_SEGMENT_LENGTH) {
+                    continue;
+                }
+            }
+
+            points.x.push_back(position.x);
+            points.y.push_back(position.y);
+            points.fade.push_back(1.0f - std::max(age, 0.0f) / TRAIL_LIFETIME);
+        }
+    }
 
-        for (auto entity : mesh_entities) {
-            const MeshComponent mesh = ecs_->get_component<MeshComponent>(entity);
+    void RenderingSystem::set_main_frame_size(uint16_t width, uint16_t height) {
+        assert(width % MAIN_FRAME_WIDTH_ALIGNMENT == 0 && "Main frame width must be aligned for the software tiles");
+        main_width_ = width;
+        main_height_ = height;
+    }
 
-            if (!renderer_->has_mesh_objects(mesh))
-                renderer_->upload_mesh(mesh);
+    void RenderingSystem::build(RenderPacket& packet, uint16_t width, uint16_t height, Entity camera,
+                                const TrailBuffer& trail, double time) {
+
+        update_mesh_uploads_(packet);
+        // Caches are only valid once the submit reports the refresh as complete, and the unfinished
+        // ones are requested again. Newer requests come back later and override this outcome
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            if (!(packet.static_shadow_refreshes & (1u << cascade))) {
+                continue;
+            }
+            StaticShadowCache& cache = static_shadow_caches_[cascade];
+            if (!(packet.refreshed_static_shadows & (1u << cascade))) {
+                cache.state = StaticShadowState::Invalid;
+            } else if (cache.state == StaticShadowState::Pending) {
+                cache.state = StaticShadowState::Valid;
+            }
+        }
 
-            const glm::mat4 model = ecs_->get_component<TransformComponent>(entity).model;
-            depth_shader->set_uniform_mat4f("model", model);
+        CameraComponent camera_data = ecs_->get_component<CameraComponent>(camera);
+        const glm::mat4 view_projection = camera_data.projection * camera_data.view;
+        const Frustum camera_frustum = extract_frustum(view_projection);
+
+        // --- Visibility ---
+
+        const DynamicAabbTree& tree = spatial_->tree();
+
+        frustum_entities_.clear();
+        frustum_bounds_.clear();
+        tree.query([&](const AABB& aabb) { return intersects(camera_frustum, aabb); },
+                   [&](ProxyId proxy) {
+                       const Entity entity = tree.get_entity(proxy);
+                       if (ecs_->has_component<ToonMaterial>(entity)) {
+                           frustum_entities_.push_back(entity);
+                           frustum_bounds_.push_back(tree.get_aabb(proxy));
+                       }
+                       return true;
+                   });
+
+        // Occluders are rasterized on the CPU, then everything in the frustum is
+        // tested against the depth pyramid
+        occlusion_culler_.begin_frame(view_projection);
+
+        auto occluders = ecs_->get_entities_with_components<OccluderComponent, TransformComponent>();
+        for (auto entity : occluders) {
+            const AABB& occluder_bounds = ecs_->get_component<OccluderComponent>(entity).bounds;
+            occlusion_culler_.add_occluder(occluder_bounds, ecs_->get_component<TransformComponent>(entity).model);
+        }
 
-            renderer_->draw_mesh(mesh);
+        unoccluded_.assign(frustum_entities_.size(), 1);
+        if (!occluders.empty()) {
+            occlusion_culler_.rasterize(pool_);
+            occlusion_culler_.test_visibility(frustum_bounds_.data(), frustum_bounds_.size(), unoccluded_.data(), pool_);
         }
-    }
 
-    void RenderingSystem::draw(uint16_t width, uint16_t height, Entity camera,
-                               const std::vector<glm::vec2>& trailPoints) {
+        visible_entities_.clear();
+        AABB receivers_bounds = {};
+        for (size_t i = 0; i < frustum_entities_.size(); i++) {
+            if (unoccluded_[i]) {
+                visible_entities_.push_back(frustum_entities_[i]);
+                expand(receivers_bounds, frustum_bounds_[i]);
+            }
+        }
 
-        ComponentArray<DirectionalLightComponent>* dir_lights_array = ecs_->get_component_array<DirectionalLightComponent>();
-        glm::mat4 light_matrix = glm::identity<glm::mat4>();
-        if (dir_lights_array->data().size()) {
-            const DirectionalLightComponent dir_light = dir_lights_array->data()[0];
+        // --- Shadows ---
 
-            glm::vec3 light_pos = dir_light.direction * 10.0f;
-            glm::mat4 light_proj = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 20.0f);
-            glm::mat4 light_view = glm::lookAt(light_pos,
-                                               glm::vec3(0.0f, 0.0f, 0.0f),
-                                               glm::vec3(0.0f, 1.0f, 0.0f));
-            light_matrix = light_proj * light_view;
+        ComponentArray<DirectionalLightComponent>* dir_lights_array = ecs_->get_component_array<DirectionalLightComponent>();
+        std::array<glm::mat4, SHADOW_CASCADE_COUNT> cascade_matrices;
+        cascade_matrices.fill(glm::identity<glm::mat4>());
+        glm::vec4 cascade_splits = glm::vec4(0.0f);
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            cascade_casters_[cascade].clear();
+            static_cascade_casters_[cascade].clear();
         }
 
-        draw_shadow_map_(light_matrix);
+        if (dir_lights_array->data().size() && is_valid(receivers_bounds)) {
+            const DirectionalLightComponent dir_light = dir_lights_array->data()[0];
 
-        renderer_->start_main_frame();
-        CameraComponent camera_data = ecs_->get_component<CameraComponent>(camera);
+            // Cascades only span the view depth of the visible receivers
+            const AABB view_bounds = transform_aabb(receivers_bounds, camera_data.view);
+            ShadowCascades cascades = fit_shadow_cascades(dir_light.direction, camera_data.view, camera_data.projection,
+                                                          -view_bounds.max.z, -view_bounds.min.z, SHADOW_MAP_WIDTH);
+
+            for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+                DirectionalShadowFit& fit = cascades.fits[cascade];
+                const Frustum caster_frustum = get_shadow_caster_frustum(fit);
+                std::vector<Entity>& casters = cascade_casters_[cascade];
+                std::vector<Entity>& static_casters = static_cascade_casters_[cascade];
+
+                shadow_caster_bounds_.clear();
+                tree.query([&](const AABB& aabb) { return intersects(caster_frustum, aabb); },
+                           [&](ProxyId proxy) {
+                               const Entity entity = tree.get_entity(proxy);
+                               const AABB& bounds = tree.get_aabb(proxy);
+                               if (ecs_->has_component<ToonMaterial>(entity) && is_shadow_caster_relevant(fit, bounds)) {
+                                   const bool is_static = ecs_->get_component<TransformComponent>(entity).is_static;
+                                   (is_static ? static_casters : casters).push_back(entity);
+                                   if (is_static) {
+                                       shadow_caster_bounds_.push_back(bounds);
+                                   }
+                               }
+                               return true;
+                           });
+                // Only static casters define the depth range, so moving casters don't invalidate the static shadow
+                include_shadow_casters(fit, shadow_caster_bounds_, SHADOW_DYNAMIC_CASTER_MARGIN);
+
+                cascade_matrices[cascade] = fit.light_matrix;
+                cascade_splits[cascade] = cascades.split_distances[cascade];
+            }
+        }
 
-        // --- Toon Material ---
+        // The static shadow of a cascade is redrawn when its light volume or one of its static casters changed
+        packet.static_shadow_refreshes = 0;
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            const uint64_t signature = get_casters_signature_(static_cascade_casters_[cascade]);
+            StaticShadowCache& cache = static_shadow_caches_[cascade];
+            if (cache.state != StaticShadowState::Invalid && cache.light_matrix == cascade_matrices[cascade] &&
+                cache.casters_signature == signature) {
+                continue;
+            }
+
+            cache = {.light_matrix = cascade_matrices[cascade], .casters_signature = signature, .state = StaticShadowState::Pending};
+            packet.static_shadow_refreshes |= 1u << cascade;
+        }
 
-        Shader* toon_shader = renderer_->get_material_shader<ToonMaterial>();
-        toon_shader->bind();
+        // --- Per frame uniforms ---
 
-        toon_shader->set_uniform_mat4f("projection", camera_data.projection);
-        toon_shader->set_uniform_mat4f("view", camera_data.view);
-        toon_shader->set_uniform_vec3f("viewPos", glm::vec3(0.0f, 2.0f, 3.0f));
+        FrameUniforms& frame = packet.uniforms;
+        frame = {
+            .projection = camera_data.projection,
+            .view = camera_data.view,
+            .cascade_matrices = cascade_matrices,
+            .cascade_splits = cascade_splits,
+            .view_pos = glm::vec3(0.0f, 2.0f, 3.0f),
+        };
 
         // --- Lights ---
 
@@ -91,54 +288,49 @@ namespace leper {
         if (dir_lights_array->data().size()) {
             const DirectionalLightComponent dir_light = dir_lights_array->data()[0];
 
-            toon_shader->set_uniform_vec3f("dirLight.dir", dir_light.direction);
-            toon_shader->set_uniform_1f("dirLight.intensity", dir_light.intensity);
-            toon_shader->set_uniform_vec3f("dirLight.col", dir_light.color);
-            toon_shader->set_uniform_mat4f("lightMatrix", light_matrix);
+            frame.dir_light.dir = dir_light.direction;
+            frame.dir_light.intensity = dir_light.intensity;
+            frame.dir_light.col = dir_light.color;
         }
 
         auto point_entities = ecs_->get_entities_with_components<PointLightComponent, TransformComponent>();
         const size_t min_point_lights = std::min(point_entities.size(), MAX_POINT_LIGHTS);
 
+        packet.point_lights.clear();
         for (size_t i = 0; i < min_point_lights; i++) {
             const Entity entity = point_entities[i];
             const TransformComponent transform = ecs_->get_component<TransformComponent>(entity);
-
-            toon_shader->set_uniform_vec3f("pointLights[" + std::to_string(i) + "].pos", transform.transform.position);
-
             const PointLightComponent point_comp = ecs_->get_component<PointLightComponent>(entity);
-            toon_shader->set_uniform_vec3f("pointLights[" + std::to_string(i) + "].col", point_comp.color);
-            toon_shader->set_uniform_1f("pointLights[" + std::to_string(i) + "].intensity", point_comp.intensity);
-        }
-
-        // --- Meshes with ToonMaterial ---
-
-        auto mesh_entities = ecs_->get_entities_with_components<MeshComponent, ToonMaterial, TransformComponent>();
-        ComponentArray<MeshComponent>* meshes_array = ecs_->get_component_array<MeshComponent>();
-
-        for (auto entity : mesh_entities) {
-            const MeshComponent mesh = ecs_->get_component<MeshComponent>(entity);
 
-            if (!renderer_->has_mesh_objects(mesh))
-                renderer_->upload_mesh(mesh);
-
-            const glm::mat4 model = ecs_->get_component<TransformComponent>(entity).model;
-            toon_shader->set_uniform_mat4f("model", model);
-            const glm::vec3 albedo = ecs_->get_component<ToonMaterial>(entity).albedo;
-            toon_shader->set_uniform_vec3f("u_color", srgb_to_linear(albedo));
-
-            renderer_->draw_mesh(mesh);
+            packet.point_lights.push_back({
+                .pos = transform.transform.position,
+                .intensity = point_comp.intensity,
+                .col = point_comp.color,
+                .range = point_comp.range,
+            });
         }
 
-        std::vector<glm::vec2> transformed_trail_points = {};
-        for (const auto& point : trailPoints) {
-            transformed_trail_points.push_back(screen_to_ndc(
-                point.x, point.y, width, height));
-        }
+        packet.light_clusters.build(camera_data.view, camera_data.projection, main_width_, main_height_, packet.point_lights, pool_);
+        frame.cluster_params = packet.light_clusters.get_params();
 
-        renderer_->finish_main_frame(width, height);
+        // --- Commands ---
 
-        renderer_->draw_trail(width, height, transformed_trail_points);
+        RenderQueue& queue = packet.queue;
+        queue.clear();
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            if (packet.static_shadow_refreshes & (1u << cascade)) {
+                queue_draws_(queue, get_static_shadow_pass(cascade), static_cascade_casters_[cascade], depth_shader_, DEPTH_SHADER_SORT_ID, cascade_matrices[cascade]);
+            }
+            queue_draws_(queue, get_shadow_pass(cascade), cascade_casters_[cascade], depth_shader_, DEPTH_SHADER_SORT_ID, cascade_matrices[cascade]);
+        }
+        queue_draws_(queue, RenderPass::Main, visible_entities_, toon_shader_, get_material_id<ToonMaterial>() + 1, view_projection);
+        queue.sort();
+
+        packet.width = width;
+        packet.height = height;
+        packet.main_width = main_width_;
+        packet.main_height = main_height_;
+        build_trail_(packet.trail, height, trail, time);
     }
 
 } // namespace leper
@@ -1,24 +1,87 @@
 #pragma once
 
+#include <array>
+
 #include "../ecs.h"
+#include "../../renderer/render_packet.h"
 #include "../../renderer/renderer.h"
+#include "spatial_system.h"
+#include "../../culling/occlusion_culler.h"
+#include "../../utils/thread_pool.h"
 #include "leper/leper_ecs_types.h"
 
 namespace leper {
 
     class RenderingSystem {
       public:
-        RenderingSystem(ECS* ecs, Renderer* renderer);
-        void draw(uint16_t width, uint16_t height, Entity camera,
-                  const std::vector<glm::vec2>& trailPoints);
+        // Creates the shaders, so the renderer must still belong to the calling thread
+        RenderingSystem(ECS* ecs, Renderer* renderer, const SpatialSystem* spatial, ThreadPool* pool);
+
+        // Culls the scene and fills the packet of the frame without touching the renderer.
+        // Meshes without a handle are requested in the packet and drawn once it comes back.
+        // Trail samples fade out over TRAIL_LIFETIME seconds before `time`
+        void build(RenderPacket& packet, uint16_t width, uint16_t height, Entity camera,
+                   const TrailBuffer& trail, double time);
+
+        // Internal resolution of the following packets
+        void set_main_frame_size(uint16_t width, uint16_t height);
 
       private:
+        // Pending between the packet requesting a refresh and its return from the submit
+        enum class StaticShadowState : uint8_t {
+            Invalid,
+            Pending,
+            Valid,
+        };
+
+        enum class MeshUploadState : uint8_t {
+            None,
+            // The vertices and indices travel in a packet until the handle comes back
+            Pending,
+            Failed,
+        };
+
+        // What the cached static shadow of a cascade was last rendered with
+        struct StaticShadowCache {
+            glm::mat4 light_matrix = glm::mat4(1.0f);
+            uint64_t casters_signature = 0;
+            StaticShadowState state = StaticShadowState::Invalid;
+        };
+
         void setup_shaders();
-        void draw_shadow_map_(const glm::mat4& light_matrix);
+        // Takes the handles of the uploads the packet carried last time and requests the missing meshes.
+        // The CPU copy moves into the packet and only comes back to the component when the upload failed
+        void update_mesh_uploads_(RenderPacket& packet);
+        // Live samples in screen pixels, without the ones too close to their predecessor to give a direction
+        void build_trail_(TrailPoints& points, uint16_t height, const TrailBuffer& trail, double time) const;
+        // Changes whenever a caster is added, removed, moved or gets another mesh
+        uint64_t get_casters_signature_(const std::vector<Entity>& casters) const;
+        // Turns the entities into commands, in parallel on the pool
+        void queue_draws_(RenderQueue& queue, RenderPass pass, const std::vector<Entity>& entities, ShaderHandle shader,
+                          uint8_t shader_sort_id, const glm::mat4& view_projection);
         void cleanup();
 
         ECS* ecs_;
-        Renderer* renderer_;
+        const SpatialSystem* spatial_;
+        ThreadPool* pool_;
+        OcclusionCuller occlusion_culler_;
+        ShaderHandle depth_shader_ = {};
+        ShaderHandle toon_shader_ = {};
+        // Indexed by Entity. Failed uploads are not retried, the arena would still be full
+        std::vector<MeshUploadState> mesh_upload_states_;
+        uint16_t main_width_ = MAIN_FRAME_WIDTH;
+        uint16_t main_height_ = MAIN_FRAME_HEIGHT;
+
+        // Per frame scratch, kept around to reuse the allocations
+        std::vector<Entity> frustum_entities_;
+        std::vector<AABB> frustum_bounds_;
+        std::vector<uint8_t> unoccluded_;
+        std::vector<Entity> visible_entities_;
+        // Dynamic casters are drawn every frame, static ones only when their cache is refreshed
+        std::array<std::vector<Entity>, SHADOW_CASCADE_COUNT> cascade_casters_;
+        std::array<std::vector<Entity>, SHADOW_CASCADE_COUNT> static_cascade_casters_;
+        std::array<StaticShadowCache, SHADOW_CASCADE_COUNT> static_shadow_caches_ = {};
+        std::vector<AABB> shadow_caster_bounds_;
     };
 
 } // namespace leper
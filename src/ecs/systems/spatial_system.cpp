@@ -0,0 +1,54 @@
+#include "spatial_system.h"
+
+#include "leper/leper_ecs_components.h"
+#include "leper/leper_rendering_constants.h"
+#include "../../math/bounds.h"
+
+namespace leper {
+
+    SpatialSystem::SpatialSystem(ECS* ecs) : ecs_(ecs) {
+        proxies_.fill(NULL_PROXY);
+        seen_versions_.fill(0);
+        seen_frames_.fill(0);
+    }
+
+    void SpatialSystem::update() {
+        frame_++;
+
+        auto mesh_entities = ecs_->get_entities_with_components<MeshComponent, TransformComponent>();
+        for (auto entity : mesh_entities) {
+            const TransformComponent& transform = ecs_->get_component<TransformComponent>(entity);
+            seen_frames_[entity] = frame_;
+
+            const bool is_tracked = proxies_[entity] != NULL_PROXY;
+            if (is_tracked && seen_versions_[entity] == transform.version) {
+                continue;
+            }
+
+            const AABB& local_bounds = ecs_->get_component<MeshComponent>(entity).bounds;
+            const AABB bounds = transform_aabb(local_bounds, transform.model);
+            const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+
+            if (!is_tracked) {
+                proxies_[entity] = tree_.create_proxy(bounds, entity);
+            } else {
+                tree_.move_proxy(proxies_[entity], bounds, center - last_centers_[entity]);
+            }
+            seen_versions_[entity] = transform.version;
+            last_centers_[entity] = center;
+        }
+
+        // Entities that lost their mesh or transform
+        if (tree_.get_proxy_count() != mesh_entities.size()) {
+            for (Entity entity = 0; entity < MAX_ENTITIES; entity++) {
+                if (proxies_[entity] != NULL_PROXY && seen_frames_[entity] != frame_) {
+                    tree_.destroy_proxy(proxies_[entity]);
+                    proxies_[entity] = NULL_PROXY;
+                }
+            }
+        }
+
+        tree_.update(BVH_REINSERTIONS_PER_FRAME);
+    }
+
+} // namespace leper
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "leper/leper_ecs_types.h"
+#include "../ecs.h"
+#include "../../spatial/dynamic_aabb_tree.h"
+
+namespace leper {
+
+    // Keeps a DynamicAabbTree in sync with the world bounds of every mesh entity.
+    // Must run after TransformSystem::update()
+    class SpatialSystem {
+      public:
+        explicit SpatialSystem(ECS* ecs);
+        void update();
+
+        const DynamicAabbTree& tree() const { return tree_; }
+
+      private:
+        ECS* ecs_;
+        DynamicAabbTree tree_;
+
+        std::array<ProxyId, MAX_ENTITIES> proxies_;
+        std::array<uint32_t, MAX_ENTITIES> seen_versions_;
+        std::array<uint32_t, MAX_ENTITIES> seen_frames_;
+        std::array<glm::vec3, MAX_ENTITIES> last_centers_;
+        uint32_t frame_ = 0;
+    };
+
+} // namespace leper
@@ -19,6 +19,7 @@ namespace leper {
                 new_model = glm::translate(new_model, comp.transform.position);
                 comp.model = new_model;
                 comp.is_dirty = false;
+                comp.version++;
             }
         }
     }
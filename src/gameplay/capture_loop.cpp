@@ -0,0 +1,234 @@
+#include "capture_loop.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace leper {
+
+    static float_t cross(const glm::vec2& a, const glm::vec2& b) {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    // Returns true and the crossing point when [p_1, p_2] and [q_1, q_2] properly intersect
+    static bool intersect_segments(const glm::vec2& p_1, const glm::vec2& p_2,
+                                   const glm::vec2& q_1, const glm::vec2& q_2, glm::vec2& crossing) {
+        const glm::vec2 r = p_2 - p_1;
+        const glm::vec2 s = q_2 - q_1;
+        const float_t denominator = cross(r, s);
+        if (denominator == 0.0f) {
+            // Parallel segments never close a loop
+            return false;
+        }
+
+        const glm::vec2 qp = q_1 - p_1;
+        const float_t t = cross(qp, s) / denominator;
+        const float_t u = cross(qp, r) / denominator;
+        if (t < 0.0f || t > 1.0f || u < 0.0f || u > 1.0f) {
+            return false;
+        }
+
+        crossing = p_1 + r * t;
+        return true;
+    }
+
+    CaptureLoopDetector::CaptureLoopDetector(float_t cell_size, uint32_t max_points)
+        : inv_cell_size_(1.0f / cell_size), bucket_mask_(std::bit_ceil(max_points) - 1) {
+        assert(max_points >= 4 && "A capture loop needs at least 4 samples");
+
+        points_.resize(max_points);
+        bucket_heads_.assign(bucket_mask_ + 1, -1);
+        entries_.reserve(4 * max_points);
+        used_buckets_.reserve(bucket_mask_ + 1);
+        loop_.reserve(max_points + 1);
+    }
+
+    uint32_t CaptureLoopDetector::get_bucket(int32_t x, int32_t y) const {
+        const uint32_t hash = (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u);
+        return hash & bucket_mask_;
+    }
+
+    void CaptureLoopDetector::clear() {
+        for (auto bucket : used_buckets_) {
+            bucket_heads_[bucket] = -1;
+        }
+        used_buckets_.clear();
+        entries_.clear();
+
+        first_sample_ = 0;
+        sample_count_ = 0;
+    }
+
+    void CaptureLoopDetector::insert_segment(uint64_t segment) {
+        const glm::vec2& a = get_point(segment);
+        const glm::vec2& b = get_point(segment + 1);
+
+        const glm::ivec2 min_cell = glm::ivec2(glm::floor(glm::min(a, b) * inv_cell_size_));
+        const glm::ivec2 max_cell = glm::ivec2(glm::floor(glm::max(a, b) * inv_cell_size_));
+
+        for (int32_t y = min_cell.y; y <= max_cell.y; y++) {
+            for (int32_t x = min_cell.x; x <= max_cell.x; x++) {
+                const uint32_t bucket = get_bucket(x, y);
+                if (bucket_heads_[bucket] == -1) {
+                    used_buckets_.push_back(bucket);
+                }
+                entries_.push_back({static_cast<uint32_t>(segment % points_.size()), bucket_heads_[bucket]});
+                bucket_heads_[bucket] = static_cast<int32_t>(entries_.size() - 1);
+            }
+        }
+    }
+
+    void CaptureLoopDetector::rebuild_grid() {
+        for (auto bucket : used_buckets_) {
+            bucket_heads_[bucket] = -1;
+        }
+        used_buckets_.clear();
+        entries_.clear();
+
+        for (uint64_t segment = first_sample_; segment + 1 < first_sample_ + sample_count_; segment++) {
+            insert_segment(segment);
+        }
+    }
+
+    bool CaptureLoopDetector::add_point(const glm::vec2& point) {
+        if (sample_count_ > 0 && get_point(first_sample_ + sample_count_ - 1) == point) {
+            return false;
+        }
+
+        // Forget the oldest sample when the ring is full. Its segment stays in the grid
+        // until the next rebuild but is filtered out below
+        if (sample_count_ == points_.size()) {
+            first_sample_++;
+            sample_count_--;
+        }
+
+        if (sample_count_ >= 2) {
+            const uint64_t last_sample = first_sample_ + sample_count_ - 1;
+            const glm::vec2& previous = get_point(last_sample);
+
+            const glm::ivec2 min_cell = glm::ivec2(glm::floor(glm::min(previous, point) * inv_cell_size_));
+            const glm::ivec2 max_cell = glm::ivec2(glm::floor(glm::max(previous, point) * inv_cell_size_));
+
+            // Oldest crossing first so the loop is the largest one the segment closes
+            uint64_t crossed_segment = UINT64_MAX;
+            glm::vec2 crossing;
+
+            for (int32_t y = min_cell.y; y <= max_cell.y; y++) {
+                for (int32_t x = min_cell.x; x <= max_cell.x; x++) {
+                    for (int32_t entry = bucket_heads_[get_bucket(x, y)]; entry != -1; entry = entries_[entry].next) {
+                        // Back to the absolute index from the ring slot
+                        const uint64_t slot = entries_[entry].segment;
+                        const uint64_t segment = first_sample_ + (slot + points_.size() - first_sample_ % points_.size()) % points_.size();
+
+                        // Forgotten, or sharing the previous sample with the new segment
+                        if (segment + 1 >= last_sample || segment >= crossed_segment) {
+                            continue;
+                        }
+
+                        glm::vec2 candidate;
+                        if (intersect_segments(previous, point, get_point(segment), get_point(segment + 1), candidate)) {
+                            crossed_segment = segment;
+                            crossing = candidate;
+                        }
+                    }
+                }
+            }
+
+            if (crossed_segment != UINT64_MAX) {
+                close_loop(crossed_segment, crossing, point);
+                return true;
+            }
+        }
+
+        points_[(first_sample_ + sample_count_) % points_.size()] = point;
+        sample_count_++;
+        if (sample_count_ >= 2) {
+            insert_segment(first_sample_ + sample_count_ - 2);
+        }
+
+        // Stale entries pile up as the trail slides, drop them once they dominate
+        if (entries_.size() > 4 * points_.size()) {
+            rebuild_grid();
+        }
+        return false;
+    }
+
+    void CaptureLoopDetector::close_loop(uint64_t crossed_segment, const glm::vec2& crossing, const glm::vec2& point) {
+        loop_.clear();
+        loop_.push_back(crossing);
+        for (uint64_t sample = crossed_segment + 1; sample < first_sample_ + sample_count_; sample++) {
+            loop_.push_back(get_point(sample));
+        }
+
+        // Start over from the crossing so the same loop isn't reported twice
+        clear();
+        add_point(crossing);
+        add_point(point);
+    }
+
+    void points_in_polygon(const std::vector<glm::vec2>& polygon, const glm::vec2* points, size_t count, uint8_t* inside) {
+        const size_t vertex_count = polygon.size();
+        if (vertex_count < 3) {
+            std::fill(inside, inside + count, 0);
+            return;
+        }
+
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) {
+            const __m128 px = _mm_setr_ps(points[i].x, points[i + 1].x, points[i + 2].x, points[i + 3].x);
+            const __m128 py = _mm_setr_ps(points[i].y, points[i + 1].y, points[i + 2].y, points[i + 3].y);
+            __m128 result = _mm_setzero_ps();
+
+            for (size_t v = 0, previous = vertex_count - 1; v < vertex_count; previous = v++) {
+                const glm::vec2& a = polygon[v];
+                const glm::vec2& b = polygon[previous];
+                if (a.y == b.y) {
+                    // Horizontal edges are never crossed by the horizontal ray
+                    continue;
+                }
+
+                const __m128 ay = _mm_set1_ps(a.y);
+                const __m128 by = _mm_set1_ps(b.y);
+                const __m128 straddles = _mm_xor_ps(_mm_cmpgt_ps(ay, py), _mm_cmpgt_ps(by, py));
+
+                const __m128 slope = _mm_set1_ps((b.x - a.x) / (b.y - a.y));
+                const __m128 x_crossing = _mm_add_ps(_mm_set1_ps(a.x), _mm_mul_ps(_mm_sub_ps(py, ay), slope));
+                const __m128 is_left = _mm_cmplt_ps(px, x_crossing);
+
+                result = _mm_xor_ps(result, _mm_and_ps(straddles, is_left));
+            }
+
+            const int mask = _mm_movemask_ps(result);
+            inside[i] = mask & 1;
+            inside[i + 1] = (mask >> 1) & 1;
+            inside[i + 2] = (mask >> 2) & 1;
+            inside[i + 3] = (mask >> 3) & 1;
+        }
+#endif
+
+        for (; i < count; i++) {
+            const glm::vec2& p = points[i];
+            bool is_inside = false;
+
+            for (size_t v = 0, previous = vertex_count - 1; v < vertex_count; previous = v++) {
+                const glm::vec2& a = polygon[v];
+                const glm::vec2& b = polygon[previous];
+                if (a.y == b.y) {
+                    continue;
+                }
+                if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+                    is_inside = !is_inside;
+                }
+            }
+            inside[i] = is_inside;
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+
+namespace leper {
+
+    // Finds the loops the cursor trail draws around creatures. Every new segment is only
+    // tested against the segments registered in the grid cells it covers, so adding a
+    // sample is O(1) on average whatever the length of the trail.
+    class CaptureLoopDetector {
+      public:
+        // `cell_size` in pixels, `max_points` samples kept in the trail before the oldest are forgotten
+        CaptureLoopDetector(float_t cell_size, uint32_t max_points);
+
+        // Returns true when the new segment crosses the trail and closes a loop. The trail
+        // then restarts from the crossing point
+        bool add_point(const glm::vec2& point);
+        void clear();
+
+        // Polygon of the last closed loop, in the coordinates of the samples
+        const std::vector<glm::vec2>& get_loop() const { return loop_; }
+
+      private:
+        struct CellEntry {
+            uint32_t segment;
+            int32_t next;
+        };
+
+        const glm::vec2& get_point(uint64_t sample) const { return points_[sample % points_.size()]; }
+        uint32_t get_bucket(int32_t x, int32_t y) const;
+        void insert_segment(uint64_t segment);
+        void rebuild_grid();
+        void close_loop(uint64_t crossed_segment, const glm::vec2& crossing, const glm::vec2& point);
+
+        float_t inv_cell_size_;
+        uint32_t bucket_mask_;
+
+        // Ring buffer of samples addressed by their absolute index, segment i goes from sample i to i + 1
+        std::vector<glm::vec2> points_;
+        uint64_t first_sample_ = 0;
+        uint64_t sample_count_ = 0;
+
+        // Grid buckets are linked lists of segments stored in one pool. Segments that
+        // fell out of the trail are skipped and dropped on the next rebuild
+        std::vector<int32_t> bucket_heads_;
+        std::vector<CellEntry> entries_;
+        std::vector<uint32_t> used_buckets_;
+
+        std::vector<glm::vec2> loop_;
+    };
+
+    // Even-odd test of many points against one polygon, four points at a time with SSE.
+    // `inside` receives 1 for the points inside, 0 otherwise
+    void points_in_polygon(const std::vector<glm::vec2>& polygon, const glm::vec2* points, size_t count, uint8_t* inside);
+
+} // namespace leper
@@ -1,4 +1,13 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <utility>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -8,29 +17,117 @@
 
 #include "asset_loading/obj_loading.h"
 #include "ecs/ecs.h"
+#include "ecs/systems/capture_system.h"
+#include "ecs/systems/proximity_system.h"
 #include "ecs/systems/rendering_system.h"
+#include "ecs/systems/spatial_system.h"
 #include "ecs/systems/transform_system.h"
 #include "leper/leper_common_types.h"
 #include "leper/leper_ecs_components.h"
 #include "leper/leper_ecs_types.h"
+#include "renderer/device/gl_render_device.h"
+#include "renderer/device/recording_render_device.h"
+#include "renderer/device/software_render_device.h"
+#include "renderer/render_thread.h"
 #include "renderer/renderer.h"
+#include "renderer/resolution_scaler.h"
+#include "renderer/trail/trail_ribbon.h"
+#include "spatial/proximity_benchmark.h"
+#include "utils/thread_pool.h"
 
-#define MAX_TRAIL_POINTS 64
+#define DEFAULT_HEADLESS_FRAMES 600
+#define SOFTWARE_FRAME_PATH "software_frame.ppm"
+#define DYNAMIC_RESOLUTION_BUDGET_MS 16.0f
+#define RENDER_SCALE_STEP 0.25f
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     spdlog::info("{}, {}", width, height);
 }
 
-std::vector<glm::vec2> trailPoints;
+leper::TrailBuffer trail;
+
+// What the GLFW callbacks can reach through the window user pointer
+struct WindowContext {
+    leper::CaptureSystem* capture = nullptr;
+    // Forwarded to the render thread with the next packet
+    bool reload_shaders_requested = false;
+    // Render scale steps from - and =, F toggles dynamic resolution
+    int32_t render_scale_steps = 0;
+    bool toggle_dynamic_resolution = false;
+};
+
+// GLFW reports the cursor in screen coordinates, which are not framebuffer pixels on HiDPI screens
+glm::vec2 get_cursor_framebuffer_position(GLFWwindow* window, double xpos, double ypos) {
+    int window_width = 0, window_height = 0, fb_width = 0, fb_height = 0;
+    glfwGetWindowSize(window, &window_width, &window_height);
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+    if (window_width <= 0 || window_height <= 0) {
+        return glm::vec2(xpos, ypos);
+    }
+    return glm::vec2(xpos * fb_width / window_width, ypos * fb_height / window_height);
+}
+
+// False when either file can't be read
+bool are_files_identical(const char* path, const char* other_path) {
+    std::ifstream file(path, std::ios::binary);
+    std::ifstream other(other_path, std::ios::binary);
+    if (!file || !other) {
+        return false;
+    }
+    return std::equal(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(),
+                      std::istreambuf_iterator<char>(other), std::istreambuf_iterator<char>());
+}
 
 void cursor_callback(GLFWwindow* window, double xpos, double ypos) {
-    trailPoints.push_back(glm::vec2(xpos, ypos));
-    if (trailPoints.size() > MAX_TRAIL_POINTS)
-        trailPoints.erase(trailPoints.begin());
+    const glm::vec2 position = get_cursor_framebuffer_position(window, xpos, ypos);
+    trail.push({.position = position, .time = glfwGetTime()});
+
+    auto context = static_cast<WindowContext*>(glfwGetWindowUserPointer(window));
+    if (context && context->capture) {
+        context->capture->add_cursor_point(position);
+    }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    const auto launch_time = std::chrono::steady_clock::now();
+
+    // --headless [frames] runs the scene without a window or GL context on the recording device,
+    // --software [frames] on the software rasterizer and writes the last frame to SOFTWARE_FRAME_PATH.
+    // --dynamic-resolution starts with the frame budget controller on instead of toggling it with F.
+    // --benchmark-proximity times the proximity grid against brute force and exits.
+    // --compare-frame <ppm> fails a --software run whose last frame differs from the given one.
+    // Flags can come in any order
+    bool software = false;
+    bool headless = false;
+    bool dynamic_resolution_requested = false;
+    bool benchmark_proximity = false;
+    const char* reference_frame_path = nullptr;
+    uint32_t headless_frames = DEFAULT_HEADLESS_FRAMES;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--software" || arg == "--headless") {
+            software = software || arg == "--software";
+            headless = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                headless_frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            }
+        } else if (arg == "--dynamic-resolution") {
+            dynamic_resolution_requested = true;
+        } else if (arg == "--benchmark-proximity") {
+            benchmark_proximity = true;
+        } else if (arg == "--compare-frame" && i + 1 < argc) {
+            reference_frame_path = argv[++i];
+        } else {
+            spdlog::warn("Ignoring unknown argument {}", arg);
+        }
+    }
+
+    if (benchmark_proximity) {
+        leper::ThreadPool thread_pool{};
+        return leper::run_proximity_benchmark(&thread_pool) ? 0 : -1;
+    }
 
+    int exit_code = 0;
     const uint16_t width = 1280u;
     const uint16_t height = 720u;
 
@@ -38,49 +135,81 @@ int main() {
     float_t ortho_height = 1.0f;
     float_t ortho_width = ortho_height * aspect;
 
-    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
-    glfwInit();
+    GLFWwindow* window = nullptr;
+    if (!headless) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
+        glfwInit();
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    glfwSetErrorCallback([](int error, const char* description) {
-        fprintf(stderr, "GLFW Error %d: %s\n", error, description);
-    });
+        glfwSetErrorCallback([](int error, const char* description) {
+            fprintf(stderr, "GLFW Error %d: %s\n", error, description);
+        });
 
-    GLFWwindow* window = glfwCreateWindow(width, height, "Leper", nullptr, nullptr);
-    if (window == nullptr) {
-        spdlog::error("Failed to create GLFW window");
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        window = glfwCreateWindow(width, height, "Leper", nullptr, nullptr);
+        if (window == nullptr) {
+            spdlog::error("Failed to create GLFW window");
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    glfwSetCursorPosCallback(window, cursor_callback);
+        glfwSetCursorPosCallback(window, cursor_callback);
+    }
 
     {
         auto sphere_mesh = leper::load_obj_mesh("sphere.obj");
         auto floor_mesh = leper::load_obj_mesh("floor.obj");
-        if (!sphere_mesh.has_value()) {
+        if (!sphere_mesh.has_value() || !floor_mesh.has_value()) {
             spdlog::error("Failed to load OBJ models");
             return -1;
         }
 
-        leper::Renderer renderer{};
+        leper::ThreadPool thread_pool{};
+
+        std::unique_ptr<leper::RenderDevice> device;
+        leper::RecordingRenderDevice* recording_device = nullptr;
+        leper::SoftwareRenderDevice* software_device = nullptr;
+        if (software) {
+            auto rasterizer = std::make_unique<leper::SoftwareRenderDevice>(&thread_pool);
+            software_device = rasterizer.get();
+            device = std::move(rasterizer);
+        } else if (headless) {
+            auto recording = std::make_unique<leper::RecordingRenderDevice>();
+            recording_device = recording.get();
+            device = std::move(recording);
+        } else {
+            device = std::make_unique<leper::GlRenderDevice>(launch_time);
+        }
 
-        glfwSetWindowUserPointer(window, &renderer);
-        glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
-            auto self = static_cast<leper::Renderer*>(glfwGetWindowUserPointer(window));
-            if (key == GLFW_KEY_R && action == GLFW_PRESS) {
-                auto renderer_ptr = static_cast<leper::Renderer*>(glfwGetWindowUserPointer(window));
-                if (renderer_ptr) {
+        leper::Renderer renderer{std::move(device)};
+        // Uploaded once, every entity copying these meshes shares their GPU data
+        sphere_mesh->handle = renderer.upload_mesh(sphere_mesh.value());
+        floor_mesh->handle = renderer.upload_mesh(floor_mesh.value());
+
+        WindowContext window_context{};
+        if (window) {
+            glfwSetWindowUserPointer(window, &window_context);
+            glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+                auto context = static_cast<WindowContext*>(glfwGetWindowUserPointer(window));
+                if (!context || action != GLFW_PRESS) {
+                    return;
+                }
+                if (key == GLFW_KEY_R) {
                     spdlog::info("Reloading shaders...");
-                    renderer_ptr->reload_shaders();
+                    context->reload_shaders_requested = true;
+                } else if (key == GLFW_KEY_MINUS) {
+                    context->render_scale_steps--;
+                } else if (key == GLFW_KEY_EQUAL) {
+                    context->render_scale_steps++;
+                } else if (key == GLFW_KEY_F) {
+                    context->toggle_dynamic_resolution = true;
                 }
-            }
-        });
+            });
+        }
 
         leper::ECS ecs;
         ecs.register_component<leper::MeshComponent>();
@@ -89,9 +218,15 @@ int main() {
         ecs.register_component<leper::CameraComponent>();
         ecs.register_component<leper::DirectionalLightComponent>();
         ecs.register_component<leper::PointLightComponent>();
+        ecs.register_component<leper::CreatureComponent>();
+        ecs.register_component<leper::OccluderComponent>();
 
         leper::TransformSystem transform_sys(&ecs);
-        leper::RenderingSystem rendering_sys(&ecs, &renderer);
+        leper::SpatialSystem spatial_sys(&ecs);
+        leper::ProximitySystem proximity_sys(&ecs, &thread_pool);
+        leper::CaptureSystem capture_sys(&ecs);
+        window_context.capture = &capture_sys;
+        leper::RenderingSystem rendering_sys(&ecs, &renderer, &spatial_sys, &thread_pool);
 
         leper::Entity camera = ecs.create_entity();
         ecs.add_component<leper::CameraComponent>(camera, {
@@ -107,10 +242,13 @@ int main() {
         ecs.add_component<leper::MeshComponent>(sphere, sphere_mesh.value());
         ecs.add_component<leper::TransformComponent>(sphere, {});
         ecs.add_component<leper::ToonMaterial>(sphere, {.albedo = {0.28f, 0.6f, 0.96f}});
+        ecs.add_component<leper::CreatureComponent>(sphere, {});
+        // Slightly smaller than the cube inscribed in the faceted unit sphere
+        ecs.add_component<leper::OccluderComponent>(sphere, {.bounds = {.min = glm::vec3(-0.55f), .max = glm::vec3(0.55f)}});
 
         leper::Entity floor = ecs.create_entity();
         ecs.add_component<leper::MeshComponent>(floor, floor_mesh.value());
-        ecs.add_component<leper::TransformComponent>(floor, {});
+        ecs.add_component<leper::TransformComponent>(floor, {.is_static = true});
         ecs.add_component<leper::ToonMaterial>(floor, {.albedo = {0.25f, 0.25f, 0.25f}});
 
         transform_sys.scale(sphere, {0.3f, 0.3f, 0.3f});
@@ -138,33 +276,115 @@ int main() {
         const float_t rot_speed = 0.01f;
         float_t theta = 0.0f;
 
-        while (!glfwWindowShouldClose(window)) {
-            glfwSwapBuffers(window);
-            glfwPollEvents();
+        leper::ResolutionScaler resolution_scaler(DYNAMIC_RESOLUTION_BUDGET_MS);
+        bool dynamic_resolution = dynamic_resolution_requested;
+
+        uint32_t frame = 0;
+        const auto start_time = std::chrono::steady_clock::now();
+        // Window, device and scene setup, programs keep building after this and log when they are all ready
+        const std::chrono::duration<double, std::milli> startup = start_time - launch_time;
+        spdlog::info("Startup took {:.1f} ms", startup.count());
+
+        {
+            // The GL context moves to the render thread with the renderer, and comes back when it stops
+            leper::RenderThreadCallbacks callbacks = {};
+            if (window) {
+                glfwMakeContextCurrent(nullptr);
+                callbacks = {
+                    .on_start = [window] { glfwMakeContextCurrent(window); },
+                    .on_frame = [window] { glfwSwapBuffers(window); },
+                    .on_stop = [] { glfwMakeContextCurrent(nullptr); },
+                };
+            }
+            leper::RenderThread render_thread(&renderer, std::move(callbacks));
 
-            auto& red_t = ecs.get_component<leper::TransformComponent>(point_red);
-            red_t.transform.position = {rot_radius * cos(theta), 1.0f, rot_radius * sin(theta)};
+            while (headless ? frame < headless_frames : !glfwWindowShouldClose(window)) {
+                int fb_width = width, fb_height = height;
+                if (window) {
+                    glfwPollEvents();
+                    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+                }
 
-            auto& green_t = ecs.get_component<leper::TransformComponent>(point_blue);
-            green_t.transform.position = {rot_radius * cos(theta + 2.095f), 1.0f, rot_radius * sin(theta + 2.095f)};
+                // Only waits when the render thread is RENDER_THREAD_QUEUE_DEPTH frames behind
+                leper::RenderPacket& packet = render_thread.acquire_packet();
 
-            auto& blue_t = ecs.get_component<leper::TransformComponent>(point_green);
-            blue_t.transform.position = {rot_radius * cos(theta + 4.188f), 1.0f, rot_radius * sin(theta + 4.188f)};
+                bool resized = false;
+                if (const int32_t steps = std::exchange(window_context.render_scale_steps, 0)) {
+                    resolution_scaler.set_scale(resolution_scaler.get_scale() + steps * RENDER_SCALE_STEP);
+                    resized = true;
+                }
+                if (std::exchange(window_context.toggle_dynamic_resolution, false)) {
+                    dynamic_resolution = !dynamic_resolution;
+                    // Frame times from before the toggle are stale
+                    resolution_scaler.reset_measurements();
+                    spdlog::info("Dynamic resolution {}", dynamic_resolution ? "on" : "off");
+                }
+                // Packets that were never submitted carry no time
+                if (dynamic_resolution && packet.submit_milliseconds > 0.0f) {
+                    resized |= resolution_scaler.add_frame_time(packet.submit_milliseconds);
+                }
+                if (resized) {
+                    rendering_sys.set_main_frame_size(resolution_scaler.get_width(), resolution_scaler.get_height());
+                    spdlog::info("Rendering at {}x{}", resolution_scaler.get_width(), resolution_scaler.get_height());
+                }
+
+                auto& red_t = ecs.get_component<leper::TransformComponent>(point_red);
+                red_t.transform.position = {rot_radius * cos(theta), 1.0f, rot_radius * sin(theta)};
+
+                auto& green_t = ecs.get_component<leper::TransformComponent>(point_blue);
+                green_t.transform.position = {rot_radius * cos(theta + 2.095f), 1.0f, rot_radius * sin(theta + 2.095f)};
 
-            // transform_sys.rotate_euler(sphere, {0.0f, 0.01f, 0.0f});
-            transform_sys.update();
+                auto& blue_t = ecs.get_component<leper::TransformComponent>(point_green);
+                blue_t.transform.position = {rot_radius * cos(theta + 4.188f), 1.0f, rot_radius * sin(theta + 4.188f)};
 
-            int fb_width, fb_height;
-            glfwGetFramebufferSize(window, &fb_width, &fb_height);
+                // transform_sys.rotate_euler(sphere, {0.0f, 0.01f, 0.0f});
+                transform_sys.update();
+                spatial_sys.update();
+                proximity_sys.update();
 
-            rendering_sys.draw(fb_width, fb_height, camera, trailPoints);
+                capture_sys.update(camera, fb_width, fb_height);
+
+                const double time = window ? glfwGetTime() : 0.0;
+                while (!trail.empty() && time - trail.front().time >= leper::TRAIL_LIFETIME) {
+                    trail.pop_front();
+                }
+                rendering_sys.build(packet, fb_width, fb_height, camera, trail, time);
+                packet.reload_shaders = std::exchange(window_context.reload_shaders_requested, false);
+                render_thread.submit(packet);
 
-            transform_sys.translate(point_red, {0.0f, 1.0f, -1.25f});
+                transform_sys.translate(point_red, {0.0f, 1.0f, -1.25f});
 
-            theta += rot_speed;
+                theta += rot_speed;
+                frame++;
+            }
+        }
+
+        if (window) {
+            glfwMakeContextCurrent(window);
+        }
+
+        if (headless && frame > 0) {
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_time;
+            spdlog::info("{} headless frames, {:.3f} ms CPU per frame", frame, elapsed.count() / frame);
+        }
+        if (software_device && frame > 0) {
+            software_device->write_ppm(SOFTWARE_FRAME_PATH);
+            if (reference_frame_path) {
+                const bool identical = are_files_identical(SOFTWARE_FRAME_PATH, reference_frame_path);
+                spdlog::info("Last frame {} {}", identical ? "matches" : "differs from", reference_frame_path);
+                exit_code = identical ? 0 : -1;
+            }
+        }
+        if (recording_device && frame > 0) {
+            const leper::RecordingStats& stats = recording_device->get_stats();
+            spdlog::info("Last frame: {} multi draws, {} indirect draws, {} instances, {} triangles, {} program binds ({} redundant)",
+                         stats.get_count(leper::RecordedCommandType::MultiDrawIndirect), stats.indirect_draws, stats.instances,
+                         stats.triangles, stats.get_count(leper::RecordedCommandType::UseProgram), stats.redundant_program_binds);
         }
     }
 
-    glfwTerminate();
-    return 0;
+    if (window) {
+        glfwTerminate();
+    }
+    return exit_code;
 }
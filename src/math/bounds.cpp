@@ -0,0 +1,89 @@
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace leper {
+
+    std::array<glm::vec3, 8> get_corners(const AABB& aabb) {
+        return {
+            glm::vec3(aabb.min.x, aabb.min.y, aabb.min.z),
+            glm::vec3(aabb.max.x, aabb.min.y, aabb.min.z),
+            glm::vec3(aabb.min.x, aabb.max.y, aabb.min.z),
+            glm::vec3(aabb.max.x, aabb.max.y, aabb.min.z),
+            glm::vec3(aabb.min.x, aabb.min.y, aabb.max.z),
+            glm::vec3(aabb.max.x, aabb.min.y, aabb.max.z),
+            glm::vec3(aabb.min.x, aabb.max.y, aabb.max.z),
+            glm::vec3(aabb.max.x, aabb.max.y, aabb.max.z),
+        };
+    }
+
+    // Arvo's method: transform the center and accumulate the absolute extents
+    // instead of transforming the 8 corners (affine matrices only)
+    AABB transform_aabb(const AABB& aabb, const glm::mat4& matrix) {
+        if (!is_valid(aabb)) {
+            return aabb;
+        }
+
+        const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+        const glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+        const glm::vec3 new_center = glm::vec3(matrix * glm::vec4(center, 1.0f));
+        glm::vec3 new_extent = glm::vec3(0.0f);
+        for (int col = 0; col < 3; col++) {
+            new_extent += glm::abs(glm::vec3(matrix[col])) * extent[col];
+        }
+
+        return AABB{.min = new_center - new_extent, .max = new_center + new_extent};
+    }
+
+    float_t intersect_ray(const Ray& ray, const glm::vec3& inv_direction, const AABB& aabb) {
+        const glm::vec3 t_1 = (aabb.min - ray.origin) * inv_direction;
+        const glm::vec3 t_2 = (aabb.max - ray.origin) * inv_direction;
+        const glm::vec3 t_near = glm::min(t_1, t_2);
+        const glm::vec3 t_far = glm::max(t_1, t_2);
+
+        const float_t t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+        const float_t t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, ray.max_distance));
+
+        return t_enter <= t_exit ? t_enter : -1.0f;
+    }
+
+    // Gribb & Hartmann plane extraction (OpenGL clip space, z in [-w, w])
+    Frustum extract_frustum(const glm::mat4& view_projection) {
+        const glm::mat4& m = view_projection;
+        const glm::vec4 row_0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row_1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row_2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row_3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum = {.planes = {
+                               row_3 + row_0, // left
+                               row_3 - row_0, // right
+                               row_3 + row_1, // bottom
+                               row_3 - row_1, // top
+                               row_3 + row_2, // near
+                               row_3 - row_2, // far
+                           }};
+
+        for (auto& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool intersects(const Frustum& frustum, const AABB& aabb) {
+        const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+        const glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+        for (const auto& plane : frustum.planes) {
+            const glm::vec3 normal = glm::vec3(plane);
+            const float_t radius = glm::dot(extent, glm::abs(normal));
+            if (glm::dot(normal, center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace leper
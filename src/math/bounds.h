@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+
+namespace leper {
+
+    // Planes are stored as (normal, distance) with normals pointing inside
+    struct Frustum {
+        std::array<glm::vec4, 6> planes;
+    };
+
+    struct Sphere {
+        glm::vec3 center = glm::vec3(0.0f);
+        float_t radius = 0.0f;
+    };
+
+    struct Ray {
+        glm::vec3 origin = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+        float_t max_distance = std::numeric_limits<float_t>::max();
+    };
+
+    inline bool is_valid(const AABB& aabb) {
+        return aabb.min.x <= aabb.max.x && aabb.min.y <= aabb.max.y && aabb.min.z <= aabb.max.z;
+    }
+
+    inline void expand(AABB& aabb, const glm::vec3& point) {
+        aabb.min = glm::min(aabb.min, point);
+        aabb.max = glm::max(aabb.max, point);
+    }
+
+    inline void expand(AABB& aabb, const AABB& other) {
+        aabb.min = glm::min(aabb.min, other.min);
+        aabb.max = glm::max(aabb.max, other.max);
+    }
+
+    inline bool overlaps(const AABB& a, const AABB& b) {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+               a.min.y <= b.max.y && a.max.y >= b.min.y &&
+               a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+    inline bool contains(const AABB& outer, const AABB& inner) {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+               outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+    }
+
+    inline AABB merge(const AABB& a, const AABB& b) {
+        return AABB{.min = glm::min(a.min, b.min), .max = glm::max(a.max, b.max)};
+    }
+
+    inline float_t surface_area(const AABB& aabb) {
+        const glm::vec3 d = aabb.max - aabb.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    inline bool intersects(const Sphere& sphere, const AABB& aabb) {
+        const glm::vec3 closest = glm::clamp(sphere.center, aabb.min, aabb.max);
+        const glm::vec3 d = closest - sphere.center;
+        return glm::dot(d, d) <= sphere.radius * sphere.radius;
+    }
+
+    // Slab test, returns the entry distance along the ray or a negative value on a miss
+    float_t intersect_ray(const Ray& ray, const glm::vec3& inv_direction, const AABB& aabb);
+
+    std::array<glm::vec3, 8> get_corners(const AABB& aabb);
+    AABB transform_aabb(const AABB& aabb, const glm::mat4& matrix);
+
+    Frustum extract_frustum(const glm::mat4& view_projection);
+    bool intersects(const Frustum& frustum, const AABB& aabb);
+
+} // namespace leper
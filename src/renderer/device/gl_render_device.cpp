@@ -0,0 +1,415 @@
+#include "gl_render_device.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <spdlog/spdlog.h>
+#include <GLFW/glfw3.h>
+
+#include "leper/leper_rendering_constants.h"
+#include "../frame_uniforms.h"
+#include "../trail/trail_ribbon.h"
+
+namespace leper {
+
+    GlRenderDevice::GlRenderDevice(std::chrono::steady_clock::time_point launch_time) : launch_time_(launch_time) {
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            spdlog::error("Failed to initalize GLAD");
+        }
+        stream_ = std::make_unique<StreamBuffer>(STREAM_BUFFER_FRAME_SIZE);
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment_);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_buffer_alignment_);
+
+        init_main_frame();
+        init_shadow_map();
+        init_trail();
+        init_mesh_arena();
+        init_parallel_compile();
+        program_cache_ = std::make_unique<ProgramBinaryCache>(PROGRAM_CACHE_DIR);
+        shader_watcher_ = std::make_unique<FileWatcher>(SHADER_DIR);
+
+        // Tiny, and the only program waited for
+        fallback_program_ = create_program("fallback.vert.glsl", "fallback.frag.glsl");
+        programs_[fallback_program_].update(false);
+        trail_program_ = create_program("trail.vert.glsl", "trail.frag.glsl");
+    }
+
+    void GlRenderDevice::init_parallel_compile() {
+        GLint extension_count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+        for (GLint i = 0; i < extension_count; i++) {
+            const auto* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (extension && std::string_view(extension) == "GL_KHR_parallel_shader_compile") {
+                parallel_compile_ = true;
+                break;
+            }
+        }
+        if (!parallel_compile_) {
+            spdlog::info("No KHR_parallel_shader_compile, program builds are waited for on the next frame");
+            return;
+        }
+
+        // Not in the generated loader. 0xFFFFFFFF lets the driver pick its maximum
+        using MaxShaderCompilerThreadsProc = void(APIENTRYP)(GLuint count);
+        const auto max_shader_compiler_threads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+        if (max_shader_compiler_threads) {
+            max_shader_compiler_threads(0xFFFFFFFFu);
+        }
+    }
+
+    void GlRenderDevice::reload_changed_programs() {
+        const std::vector<std::string> changed = shader_watcher_->poll();
+        if (changed.empty()) {
+            return;
+        }
+
+        size_t reloaded = 0;
+        for (Shader& program : programs_) {
+            if (std::any_of(changed.begin(), changed.end(), [&](const std::string& file) { return program.depends_on(file); })) {
+                program.reload();
+                reloaded++;
+            }
+        }
+        // Editor swap and backup files land here too
+        if (reloaded == 0) {
+            return;
+        }
+
+        spdlog::info("Shader files changed, rebuilding {} of {} programs", reloaded, programs_.size());
+        // Programs found in the binary cache are replaced right away and get new names
+        state_.invalidate();
+    }
+
+    void GlRenderDevice::update_programs() {
+        bool replaced = false;
+        for (Shader& program : programs_) {
+            replaced |= program.update(parallel_compile_);
+        }
+        // Replaced programs are deleted, and their names may be handed out again
+        if (replaced) {
+            state_.invalidate();
+        }
+
+        // Builds finish in the background after startup, so this is the time to compare a cold
+        // program binary cache with a warm one
+        if (!all_programs_ready_ && std::all_of(programs_.begin(), programs_.end(), [](const Shader& program) { return program.is_ready(); })) {
+            all_programs_ready_ = true;
+            const size_t cached = std::count_if(programs_.begin(), programs_.end(), [](const Shader& program) { return program.is_from_binary_cache(); });
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - launch_time_;
+            spdlog::info("All {} programs ready {:.1f} ms after launch, {} from the binary cache", programs_.size(), elapsed.count(), cached);
+        }
+    }
+
+    bool GlRenderDevice::is_program_ready(ProgramId program) const {
+        assert(program < programs_.size() && "Unknown program");
+        return programs_[program].is_ready();
+    }
+
+    TextureHandle GlRenderDevice::create_texture(GLenum target) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        return textures_.insert({.texture = texture, .target = target});
+    }
+
+    GLuint GlRenderDevice::get_texture(TextureHandle texture) const {
+        const TextureGlObjects* objects = textures_.get(texture);
+        return objects ? objects->texture : 0;
+    }
+
+    void GlRenderDevice::init_main_frame() {
+        glGenFramebuffers(1, &main_fbo_);
+        state_.bind_framebuffer(GL_FRAMEBUFFER, main_fbo_);
+
+        main_texture_ = create_texture(GL_TEXTURE_2D);
+        glGenRenderbuffers(1, &main_depth_rbo_);
+        allocate_main_frame();
+
+        state_.bind_texture(0, GL_TEXTURE_2D, get_texture(main_texture_));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // Attach
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, get_texture(main_texture_), 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, main_depth_rbo_);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            spdlog::error("Framebuffer is not complete!");
+        }
+
+        state_.bind_texture(0, GL_TEXTURE_2D, 0);
+        state_.bind_framebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void GlRenderDevice::allocate_main_frame() {
+        // Mutable storage, so the attachments stay valid when it is specified again
+        state_.bind_texture(0, GL_TEXTURE_2D, get_texture(main_texture_));
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, main_width_, main_height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        state_.bind_texture(0, GL_TEXTURE_2D, 0);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, main_depth_rbo_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, main_width_, main_height_);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    void GlRenderDevice::resize_main_frame(uint16_t width, uint16_t height) {
+        if (width == main_width_ && height == main_height_) {
+            return;
+        }
+
+        main_width_ = width;
+        main_height_ = height;
+        allocate_main_frame();
+    }
+
+    void GlRenderDevice::init_shadow_map() {
+        shadow_map_ = create_shadow_array(shadow_map_fbos_);
+        static_shadow_map_ = create_shadow_array(static_shadow_fbos_);
+
+        // The static cache is copied before anything is drawn into it
+        for (auto fbo : static_shadow_fbos_) {
+            state_.bind_framebuffer(GL_FRAMEBUFFER, fbo);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+        state_.bind_framebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    TextureHandle GlRenderDevice::create_shadow_array(std::array<GLuint, SHADOW_CASCADE_COUNT>& fbos) {
+        const TextureHandle texture = create_texture(GL_TEXTURE_2D_ARRAY);
+        state_.bind_texture(0, GL_TEXTURE_2D_ARRAY, get_texture(texture));
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
+                     SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, SHADOW_CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        glGenFramebuffers(SHADOW_CASCADE_COUNT, fbos.data());
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            state_.bind_framebuffer(GL_FRAMEBUFFER, fbos[cascade]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, get_texture(texture), 0, cascade);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                spdlog::error("Shadow map framebuffer of cascade {} is not complete!", cascade);
+            }
+        }
+
+        state_.bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+        state_.bind_framebuffer(GL_FRAMEBUFFER, 0);
+        return texture;
+    }
+
+    void GlRenderDevice::init_trail() {
+        glGenVertexArrays(1, &trail_vao_);
+
+        // Vertices are streamed, draws start at their allocation
+        state_.bind_vertex_array(trail_vao_);
+        state_.bind_buffer(GL_ARRAY_BUFFER, stream_->get_buffer());
+
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, alpha));
+        glEnableVertexAttribArray(1);
+
+        // Only the trail blends, so the function is set once
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        state_.bind_buffer(GL_ARRAY_BUFFER, 0);
+        state_.bind_vertex_array(0);
+    }
+
+    void GlRenderDevice::init_mesh_arena() {
+        mesh_arena_ = std::make_unique<MeshArena>(MESH_ARENA_VERTEX_CAPACITY, MESH_ARENA_INDEX_CAPACITY);
+
+        // Instance attributes: model matrix as 4 columns, then the color
+        // Base instances of the draws point at the streamed instances of the frame
+        const GLuint vao = mesh_arena_->get_vao();
+        glVertexArrayVertexBuffer(vao, INSTANCE_BINDING, stream_->get_buffer(), 0, sizeof(InstanceData));
+        glVertexArrayBindingDivisor(vao, INSTANCE_BINDING, 1);
+
+        for (GLuint column = 0; column < 4; column++) {
+            const GLuint location = INSTANCE_MODEL_LOCATION + column;
+            glEnableVertexArrayAttrib(vao, location);
+            glVertexArrayAttribFormat(vao, location, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+            glVertexArrayAttribBinding(vao, location, INSTANCE_BINDING);
+        }
+        glEnableVertexArrayAttrib(vao, INSTANCE_COLOR_LOCATION);
+        glVertexArrayAttribFormat(vao, INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, color));
+        glVertexArrayAttribBinding(vao, INSTANCE_COLOR_LOCATION, INSTANCE_BINDING);
+    }
+
+    void GlRenderDevice::begin_frame() {
+        state_.reset_stats();
+        stream_->begin_frame();
+        reload_changed_programs();
+        update_programs();
+    }
+
+    void GlRenderDevice::end_frame() {
+        stream_->end_frame();
+    }
+
+    StreamAllocation GlRenderDevice::allocate_stream(size_t size, size_t alignment) {
+        return stream_->allocate(size, alignment);
+    }
+
+    std::optional<MeshRange> GlRenderDevice::allocate_mesh(const Mesh& mesh) {
+        return mesh_arena_->allocate(mesh);
+    }
+
+    void GlRenderDevice::free_mesh(const MeshRange& range) {
+        mesh_arena_->free(range);
+    }
+
+    ProgramId GlRenderDevice::create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) {
+        programs_.emplace_back(vertex_shader_name, fragment_shader_name, program_cache_.get());
+        return static_cast<ProgramId>(programs_.size() - 1);
+    }
+
+    void GlRenderDevice::reload_programs() {
+        // Programs found in the binary cache are replaced right away and get new names
+        state_.invalidate();
+        for (auto& program : programs_) {
+            program.reload();
+        }
+    }
+
+    void GlRenderDevice::begin_pass(RenderPass pass) {
+        current_pass_ = pass;
+        if (is_static_shadow_pass(pass) || is_shadow_pass(pass)) {
+            const uint32_t cascade = get_shadow_cascade(pass);
+            if (is_static_shadow_pass(pass)) {
+                state_.bind_framebuffer(GL_FRAMEBUFFER, static_shadow_fbos_[cascade]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+            } else {
+                // Dynamic casters are drawn on top of the cached static ones
+                state_.bind_framebuffer(GL_FRAMEBUFFER, shadow_map_fbos_[cascade]);
+                glCopyImageSubData(get_texture(static_shadow_map_), GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+                                   get_texture(shadow_map_), GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+                                   SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 1);
+            }
+            state_.viewport(0, 0, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
+
+            state_.set_enabled(GlCapability::DepthTest, true);
+            // Set by every pass, the trail turns it off and the cached static layer must not depend on that
+            state_.set_enabled(GlCapability::CullFace, true);
+
+            // Tells the depth program which cascade matrix to use
+            const StreamAllocation uniforms = stream_->allocate(sizeof(ShadowPassUniforms), uniform_buffer_alignment_);
+            if (uniforms.is_valid()) {
+                *static_cast<ShadowPassUniforms*>(uniforms.data) = {.cascade = cascade};
+                state_.bind_buffer_range(GL_UNIFORM_BUFFER, SHADOW_PASS_UNIFORMS_BINDING, stream_->get_buffer(), uniforms.offset, uniforms.size);
+            }
+            return;
+        }
+
+        switch (pass) {
+        case RenderPass::Main:
+            state_.bind_framebuffer(GL_FRAMEBUFFER, main_fbo_);
+            state_.viewport(0, 0, main_width_, main_height_);
+
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            state_.set_enabled(GlCapability::DepthTest, true);
+            state_.set_enabled(GlCapability::CullFace, true);
+            state_.set_enabled(GlCapability::FramebufferSrgb, true);
+
+            state_.bind_texture(0, GL_TEXTURE_2D_ARRAY, get_texture(shadow_map_));
+            break;
+        default:
+            break;
+        }
+    }
+
+    void GlRenderDevice::bind_frame_uniforms(const StreamAllocation& uniforms) {
+        state_.bind_buffer_range(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, stream_->get_buffer(), uniforms.offset, uniforms.size);
+    }
+
+    void GlRenderDevice::bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) {
+        state_.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, POINT_LIGHTS_BINDING, stream_->get_buffer(), lights.offset, lights.size);
+        state_.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTERS_BINDING, stream_->get_buffer(), clusters.offset, clusters.size);
+        state_.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, LIGHT_INDICES_BINDING, stream_->get_buffer(), indices.offset, indices.size);
+    }
+
+    void GlRenderDevice::use_program(ProgramId program) {
+        assert(program < programs_.size() && "Unknown program");
+
+        // A program still building is stood in for by the unlit fallback in the main pass.
+        // Shadow passes have no stand in and skip its draws
+        GLuint name = programs_[program].get_program();
+        if (name == 0 && current_pass_ == RenderPass::Main) {
+            name = programs_[fallback_program_].get_program();
+        }
+
+        skip_draws_ = name == 0;
+        if (!skip_draws_) {
+            state_.use_program(name);
+        }
+    }
+
+    void GlRenderDevice::bind_meshes() {
+        // Every mesh lives in the arena, so this is the only VAO of both passes
+        state_.bind_vertex_array(mesh_arena_->get_vao());
+        state_.bind_buffer(GL_DRAW_INDIRECT_BUFFER, stream_->get_buffer());
+    }
+
+    void GlRenderDevice::multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) {
+        if (skip_draws_) {
+            return;
+        }
+        const GLintptr offset = commands.offset + first * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, static_cast<GLsizei>(count), 0);
+    }
+
+    void GlRenderDevice::present(uint16_t width, uint16_t height) {
+        // Set default framebuffer to screen
+        state_.bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        state_.bind_framebuffer(GL_READ_FRAMEBUFFER, main_fbo_);
+
+        glBlitFramebuffer(0, 0, main_width_, main_height_,
+                          0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT,
+                          GL_NEAREST);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    void GlRenderDevice::draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) {
+        if (!programs_[trail_program_].is_ready()) {
+            return;
+        }
+
+        state_.bind_framebuffer(GL_FRAMEBUFFER, 0);
+        state_.viewport(0, 0, width, height);
+        state_.set_enabled(GlCapability::DepthTest, false);
+        // Both windings show up along a strip that turns back on itself
+        state_.set_enabled(GlCapability::CullFace, false);
+        state_.set_enabled(GlCapability::Blend, true);
+
+        state_.use_program(programs_[trail_program_].get_program());
+        state_.bind_vertex_array(trail_vao_);
+
+        const GLint first = static_cast<GLint>(vertices.offset / sizeof(TrailVertex));
+        glDrawArrays(GL_TRIANGLE_STRIP, first, count);
+
+        state_.set_enabled(GlCapability::Blend, false);
+    }
+
+    GlRenderDevice::~GlRenderDevice() {
+        glDeleteRenderbuffers(1, &main_depth_rbo_);
+        glDeleteFramebuffers(1, &main_fbo_);
+
+        glDeleteVertexArrays(1, &trail_vao_);
+
+        glDeleteFramebuffers(SHADOW_CASCADE_COUNT, shadow_map_fbos_.data());
+        glDeleteFramebuffers(SHADOW_CASCADE_COUNT, static_shadow_fbos_.data());
+
+        textures_.for_each([](TextureGlObjects& objects) { glDeleteTextures(1, &objects.texture); });
+        for (auto& program : programs_) {
+            program.cleanup();
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+
+#include "render_device.h"
+#include "../gl_state_cache.h"
+#include "../mesh_arena.h"
+#include "../stream_buffer.h"
+#include "../shader/program_binary_cache.h"
+#include "../shader/shader.h"
+#include "../../utils/file_watcher.h"
+#include "../../utils/handle_pool.h"
+
+namespace leper {
+
+    // OpenGL 4.6 backend, needs a current context when constructed
+    class GlRenderDevice : public RenderDevice {
+      public:
+        // `launch_time` is when the process started, for the time until every program is ready
+        explicit GlRenderDevice(std::chrono::steady_clock::time_point launch_time);
+        ~GlRenderDevice() override;
+
+        void begin_frame() override;
+        void end_frame() override;
+
+        StreamAllocation allocate_stream(size_t size, size_t alignment) override;
+        size_t get_uniform_buffer_alignment() const override { return uniform_buffer_alignment_; }
+        size_t get_storage_buffer_alignment() const override { return storage_buffer_alignment_; }
+
+        std::optional<MeshRange> allocate_mesh(const Mesh& mesh) override;
+        void free_mesh(const MeshRange& range) override;
+
+        ProgramId create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) override;
+        void reload_programs() override;
+        bool is_program_ready(ProgramId program) const override;
+
+        void resize_main_frame(uint16_t width, uint16_t height) override;
+
+        void begin_pass(RenderPass pass) override;
+        void bind_frame_uniforms(const StreamAllocation& uniforms) override;
+        void bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) override;
+        void use_program(ProgramId program) override;
+        void bind_meshes() override;
+        void multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) override;
+        void present(uint16_t width, uint16_t height) override;
+        void draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) override;
+
+        const GlStateStats& get_state_stats() const { return state_.get_stats(); }
+
+      private:
+        void init_main_frame();
+        // (Re)specifies the storage of the main color and depth for the current size
+        void allocate_main_frame();
+        void init_shadow_map();
+        void init_trail();
+        void init_mesh_arena();
+        void init_parallel_compile();
+        // Rebuilds the programs using a shader file written since the last frame
+        void reload_changed_programs();
+        // Swaps in the programs whose build is done
+        void update_programs();
+
+        // Depth array with one layer and one framebuffer per cascade
+        TextureHandle create_shadow_array(std::array<GLuint, SHADOW_CASCADE_COUNT>& fbos);
+        TextureHandle create_texture(GLenum target);
+        // 0 for stale handles
+        GLuint get_texture(TextureHandle texture) const;
+
+        GlStateCache state_;
+
+        // Instances, uniform blocks, indirect commands and trail points are all written here
+        std::unique_ptr<StreamBuffer> stream_;
+        GLint uniform_buffer_alignment_ = 0;
+        GLint storage_buffer_alignment_ = 0;
+
+        std::unique_ptr<MeshArena> mesh_arena_;
+        // Indexed by ProgramId
+        std::vector<Shader> programs_;
+        std::unique_ptr<ProgramBinaryCache> program_cache_;
+        std::unique_ptr<FileWatcher> shader_watcher_;
+        // KHR_parallel_shader_compile, builds can be polled without waiting for them
+        bool parallel_compile_ = false;
+        std::chrono::steady_clock::time_point launch_time_;
+        // Set once every program finished its first build
+        bool all_programs_ready_ = false;
+        // Unlit, drawn in the main pass by programs that are still building
+        ProgramId fallback_program_ = 0;
+        RenderPass current_pass_ = RenderPass::Main;
+        // Set while the bound program has nothing to stand in for it
+        bool skip_draws_ = false;
+        HandlePool<TextureGlObjects, TextureTag> textures_;
+
+        GLuint main_fbo_ = 0;
+        TextureHandle main_texture_ = {};
+        GLuint main_depth_rbo_ = 0;
+        uint16_t main_width_ = MAIN_FRAME_WIDTH;
+        uint16_t main_height_ = MAIN_FRAME_HEIGHT;
+
+        // One framebuffer per layer of the cascade array
+        std::array<GLuint, SHADOW_CASCADE_COUNT> shadow_map_fbos_ = {};
+        TextureHandle shadow_map_ = {};
+        // Static casters only, copied into the shadow map at the start of each shadow pass
+        std::array<GLuint, SHADOW_CASCADE_COUNT> static_shadow_fbos_ = {};
+        TextureHandle static_shadow_map_ = {};
+
+        ProgramId trail_program_ = 0;
+        GLuint trail_vao_ = 0;
+    };
+
+} // namespace leper
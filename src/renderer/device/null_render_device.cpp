@@ -0,0 +1,78 @@
+#include "null_render_device.h"
+
+#include <spdlog/spdlog.h>
+
+#include "leper/leper_rendering_constants.h"
+
+namespace leper {
+
+    // Most common GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    constexpr size_t NULL_UNIFORM_BUFFER_ALIGNMENT = 256;
+    // Largest common GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    constexpr size_t NULL_STORAGE_BUFFER_ALIGNMENT = 256;
+
+    NullRenderDevice::NullRenderDevice()
+        : stream_memory_(STREAM_BUFFER_FRAME_SIZE),
+          vertices_(MESH_ARENA_VERTEX_CAPACITY),
+          indices_(MESH_ARENA_INDEX_CAPACITY) {}
+
+    void NullRenderDevice::begin_frame() {
+        // Nothing reads the memory after the frame, a single region is enough
+        stream_offset_ = 0;
+    }
+
+    StreamAllocation NullRenderDevice::allocate_stream(size_t size, size_t alignment) {
+        const size_t aligned = (stream_offset_ + alignment - 1) / alignment * alignment;
+        if (aligned + size > stream_memory_.size()) {
+            spdlog::warn("Stream buffer is full, dropping an allocation of {} bytes", size);
+            return {};
+        }
+
+        stream_offset_ = aligned + size;
+        return {
+            .data = stream_memory_.data() + aligned,
+            .offset = static_cast<GLintptr>(aligned),
+            .size = static_cast<GLsizeiptr>(size),
+        };
+    }
+
+    size_t NullRenderDevice::get_uniform_buffer_alignment() const {
+        return NULL_UNIFORM_BUFFER_ALIGNMENT;
+    }
+
+    size_t NullRenderDevice::get_storage_buffer_alignment() const {
+        return NULL_STORAGE_BUFFER_ALIGNMENT;
+    }
+
+    std::optional<MeshRange> NullRenderDevice::allocate_mesh(const Mesh& mesh) {
+        const uint32_t vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        const uint32_t index_count = static_cast<uint32_t>(mesh.indices.size());
+
+        const std::optional<uint32_t> first_vertex = vertices_.allocate(vertex_count);
+        if (!first_vertex.has_value()) {
+            return {};
+        }
+        const std::optional<uint32_t> first_index = indices_.allocate(index_count);
+        if (!first_index.has_value()) {
+            vertices_.free(first_vertex.value(), vertex_count);
+            return {};
+        }
+
+        return MeshRange{
+            .first_index = first_index.value(),
+            .index_count = index_count,
+            .first_vertex = first_vertex.value(),
+            .vertex_count = vertex_count,
+        };
+    }
+
+    void NullRenderDevice::free_mesh(const MeshRange& range) {
+        vertices_.free(range.first_vertex, range.vertex_count);
+        indices_.free(range.first_index, range.index_count);
+    }
+
+    ProgramId NullRenderDevice::create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) {
+        return next_program_++;
+    }
+
+} // namespace leper
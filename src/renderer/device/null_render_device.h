@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "render_device.h"
+#include "../../utils/free_list_allocator.h"
+
+namespace leper {
+
+    // Runs the whole frame build without a graphics API
+    // Streamed memory and mesh storage are still allocated, so limits and offsets match the GL backend
+    class NullRenderDevice : public RenderDevice {
+      public:
+        NullRenderDevice();
+
+        void begin_frame() override;
+        void end_frame() override {}
+
+        StreamAllocation allocate_stream(size_t size, size_t alignment) override;
+        size_t get_uniform_buffer_alignment() const override;
+        size_t get_storage_buffer_alignment() const override;
+
+        std::optional<MeshRange> allocate_mesh(const Mesh& mesh) override;
+        void free_mesh(const MeshRange& range) override;
+
+        ProgramId create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) override;
+        void reload_programs() override {}
+        bool is_program_ready(ProgramId program) const override { return true; }
+
+        void resize_main_frame(uint16_t width, uint16_t height) override {}
+
+        void begin_pass(RenderPass pass) override {}
+        void bind_frame_uniforms(const StreamAllocation& uniforms) override {}
+        void bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) override {}
+        void use_program(ProgramId program) override {}
+        void bind_meshes() override {}
+        void multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) override {}
+        void present(uint16_t width, uint16_t height) override {}
+        void draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) override {}
+
+      protected:
+        // Allocation offsets are relative to this
+        const uint8_t* get_stream_memory() const { return stream_memory_.data(); }
+
+      private:
+        std::vector<uint8_t> stream_memory_;
+        size_t stream_offset_ = 0;
+
+        FreeListAllocator vertices_;
+        FreeListAllocator indices_;
+        ProgramId next_program_ = 0;
+    };
+
+} // namespace leper
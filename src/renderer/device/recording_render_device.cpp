@@ -0,0 +1,69 @@
+#include "recording_render_device.h"
+
+namespace leper {
+
+    // Enough for a frame of the current renderer without reallocating
+    constexpr size_t RECORDED_COMMANDS_RESERVE = 256;
+
+    RecordingRenderDevice::RecordingRenderDevice() {
+        commands_.reserve(RECORDED_COMMANDS_RESERVE);
+    }
+
+    void RecordingRenderDevice::record(RecordedCommandType type, uint32_t argument) {
+        commands_.push_back({.type = type, .argument = argument});
+        stats_.commands[static_cast<size_t>(type)]++;
+    }
+
+    void RecordingRenderDevice::begin_frame() {
+        NullRenderDevice::begin_frame();
+        commands_.clear();
+        stats_ = {};
+        has_program_ = false;
+    }
+
+    void RecordingRenderDevice::begin_pass(RenderPass pass) {
+        record(RecordedCommandType::BeginPass, static_cast<uint32_t>(pass));
+    }
+
+    void RecordingRenderDevice::bind_frame_uniforms(const StreamAllocation& uniforms) {
+        record(RecordedCommandType::BindFrameUniforms, static_cast<uint32_t>(uniforms.size));
+    }
+
+    void RecordingRenderDevice::bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) {
+        record(RecordedCommandType::BindLightClusters, static_cast<uint32_t>(indices.size / sizeof(uint32_t)));
+    }
+
+    void RecordingRenderDevice::use_program(ProgramId program) {
+        if (has_program_ && program == current_program_) {
+            stats_.redundant_program_binds++;
+        }
+        current_program_ = program;
+        has_program_ = true;
+        record(RecordedCommandType::UseProgram, program);
+    }
+
+    void RecordingRenderDevice::bind_meshes() {
+        record(RecordedCommandType::BindMeshes, 0);
+    }
+
+    void RecordingRenderDevice::multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) {
+        record(RecordedCommandType::MultiDrawIndirect, static_cast<uint32_t>(count));
+
+        // The stream memory is plain CPU memory here, so the commands can be read back
+        const DrawElementsIndirectCommand* indirect = static_cast<const DrawElementsIndirectCommand*>(commands.data) + first;
+        for (size_t i = 0; i < count; i++) {
+            stats_.indirect_draws++;
+            stats_.instances += indirect[i].instance_count;
+            stats_.triangles += static_cast<uint64_t>(indirect[i].count / 3) * indirect[i].instance_count;
+        }
+    }
+
+    void RecordingRenderDevice::present(uint16_t width, uint16_t height) {
+        record(RecordedCommandType::Present, 0);
+    }
+
+    void RecordingRenderDevice::draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) {
+        record(RecordedCommandType::DrawScreenRibbon, count);
+    }
+
+} // namespace leper
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "null_render_device.h"
+
+namespace leper {
+
+    enum class RecordedCommandType : uint8_t {
+        BeginPass,
+        BindFrameUniforms,
+        BindLightClusters,
+        UseProgram,
+        BindMeshes,
+        MultiDrawIndirect,
+        Present,
+        DrawScreenRibbon,
+        Count,
+    };
+
+    struct RecordedCommand {
+        RecordedCommandType type;
+        // Pass, program, light index count or indirect command count depending on the type
+        uint32_t argument;
+    };
+
+    struct RecordingStats {
+        std::array<uint32_t, static_cast<size_t>(RecordedCommandType::Count)> commands = {};
+        // Binds of the program that was already in use
+        uint32_t redundant_program_binds = 0;
+        uint32_t indirect_draws = 0;
+        uint64_t instances = 0;
+        uint64_t triangles = 0;
+
+        uint32_t get_count(RecordedCommandType type) const { return commands[static_cast<size_t>(type)]; }
+    };
+
+    // Null device that keeps the command stream of the last frame, for headless
+    // benchmarks and regression checks of the frame build
+    class RecordingRenderDevice : public NullRenderDevice {
+      public:
+        RecordingRenderDevice();
+
+        void begin_frame() override;
+
+        void begin_pass(RenderPass pass) override;
+        void bind_frame_uniforms(const StreamAllocation& uniforms) override;
+        void bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) override;
+        void use_program(ProgramId program) override;
+        void bind_meshes() override;
+        void multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) override;
+        void present(uint16_t width, uint16_t height) override;
+        void draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) override;
+
+        const std::vector<RecordedCommand>& get_commands() const { return commands_; }
+        const RecordingStats& get_stats() const { return stats_; }
+
+      private:
+        void record(RecordedCommandType type, uint32_t argument);
+
+        std::vector<RecordedCommand> commands_;
+        RecordingStats stats_ = {};
+        ProgramId current_program_ = 0;
+        bool has_program_ = false;
+    };
+
+} // namespace leper
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_rendering_types.h"
+#include "../render_queue.h"
+
+namespace leper {
+
+    using ProgramId = uint32_t;
+
+    // Everything the renderer asks of the graphics API. Renderer keeps the frame logic
+    // (batching, instancing, indirect commands) and devices only execute it
+    class RenderDevice {
+      public:
+        virtual ~RenderDevice() = default;
+
+        virtual void begin_frame() = 0;
+        virtual void end_frame() = 0;
+
+        // CPU writable memory read by the commands of the current frame
+        virtual StreamAllocation allocate_stream(size_t size, size_t alignment) = 0;
+        virtual size_t get_uniform_buffer_alignment() const = 0;
+        virtual size_t get_storage_buffer_alignment() const = 0;
+
+        // Returns nothing when the mesh storage is full
+        virtual std::optional<MeshRange> allocate_mesh(const Mesh& mesh) = 0;
+        virtual void free_mesh(const MeshRange& range) = 0;
+
+        virtual ProgramId create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) = 0;
+        // Programs build in the background and keep their previous version while reloading
+        virtual void reload_programs() = 0;
+        // False until the first build of the program is done. Draws meanwhile use a fallback or are skipped
+        virtual bool is_program_ready(ProgramId program) const = 0;
+
+        // Reallocates the main target, the width is a multiple of MAIN_FRAME_WIDTH_ALIGNMENT
+        virtual void resize_main_frame(uint16_t width, uint16_t height) = 0;
+
+        // Binds and clears the pass target. Shadow passes start from a copy of the
+        // static shadow cache of their cascade instead of a cleared layer
+        virtual void begin_pass(RenderPass pass) = 0;
+        // Allocation holding a FrameUniforms
+        virtual void bind_frame_uniforms(const StreamAllocation& uniforms) = 0;
+        // Allocations holding the GpuPointLight array, one GpuLightCluster per cluster and
+        // the uint32_t light indices they point into
+        virtual void bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) = 0;
+        virtual void use_program(ProgramId program) = 0;
+        // Binds the shared mesh storage and the streamed instances for the following draws
+        virtual void bind_meshes() = 0;
+        // Draws count DrawElementsIndirectCommand starting at first in the allocation
+        virtual void multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) = 0;
+        // Scales the main target to the screen
+        virtual void present(uint16_t width, uint16_t height) = 0;
+        // Alpha blended triangle strip of TrailVertex on the screen, on top of everything
+        virtual void draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) = 0;
+    };
+
+} // namespace leper
@@ -0,0 +1,680 @@
+#include "software_render_device.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "leper/leper_rendering_constants.h"
+#include "../trail/trail_ribbon.h"
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace leper {
+
+    constexpr uint16_t TILE_WIDTH = 32;
+    constexpr uint16_t TILE_HEIGHT = 16;
+
+    // Constants of the GL programs and pass setup
+    constexpr float_t MAIN_CLEAR_COLOR = 0.05f;
+    constexpr float_t SHADOW_BIAS = 0.005f;
+    constexpr float_t AMBIENT = 0.3f;
+    constexpr uint32_t TRAIL_COLOR = 0xffffffffu;
+
+    constexpr size_t SRGB_TABLE_SIZE = 4096;
+
+    // Linear [0, 1] to 8 bit sRGB, what GL_FRAMEBUFFER_SRGB does on write
+    static const std::array<uint8_t, SRGB_TABLE_SIZE>& get_srgb_table() {
+        static const std::array<uint8_t, SRGB_TABLE_SIZE> table = [] {
+            std::array<uint8_t, SRGB_TABLE_SIZE> result;
+            for (size_t i = 0; i < SRGB_TABLE_SIZE; i++) {
+                const float_t linear = static_cast<float_t>(i) / (SRGB_TABLE_SIZE - 1);
+                const float_t encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                result[i] = static_cast<uint8_t>(std::lround(encoded * 255.0f));
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    static uint32_t pack_srgb(const glm::vec3& color) {
+        const auto& table = get_srgb_table();
+        auto encode = [&](float_t channel) -> uint32_t {
+            const float_t clamped = std::clamp(channel, 0.0f, 1.0f);
+            return table[static_cast<size_t>(clamped * (SRGB_TABLE_SIZE - 1) + 0.5f)];
+        };
+        return encode(color.r) | (encode(color.g) << 8) | (encode(color.b) << 16) | 0xff000000u;
+    }
+
+    static float_t smoothstep(float_t edge0, float_t edge1, float_t x) {
+        const float_t t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    // a * x + b * y + c, positive left of p -> q, so inside counter clockwise triangles
+    struct EdgeFunction {
+        float_t a;
+        float_t b;
+        float_t c;
+        // Whether pixels exactly on the edge belong to this side
+        bool inclusive;
+
+        float_t evaluate(const glm::vec2& point) const { return a * point.x + b * point.y + c; }
+        bool contains(const glm::vec2& point) const {
+            const float_t value = evaluate(point);
+            return value > 0.0f || (value == 0.0f && inclusive);
+        }
+    };
+
+    static EdgeFunction setup_edge(glm::vec2 p, glm::vec2 q) {
+        // Shared edges are set up from their lower vertex, so both triangles get the same function
+        // and exactly one of them owns the pixels on it
+        const bool flipped = p.y > q.y || (p.y == q.y && p.x > q.x);
+        if (flipped) {
+            std::swap(p, q);
+        }
+
+        const float_t sign = flipped ? -1.0f : 1.0f;
+        return {
+            .a = sign * (p.y - q.y),
+            .b = sign * (q.x - p.x),
+            .c = sign * ((q.y - p.y) * p.x - (q.x - p.x) * p.y),
+            .inclusive = !flipped,
+        };
+    }
+
+    SoftwareRenderDevice::SoftwareRenderDevice(ThreadPool* pool)
+        : pool_(pool),
+          main_(create_target(MAIN_FRAME_WIDTH, MAIN_FRAME_HEIGHT, true)) {
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            static_shadow_[cascade] = create_target(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, false);
+            shadow_[cascade] = create_target(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, false);
+            // Dynamic casters are drawn on top of the cached static ones
+            shadow_[cascade].clear_source = &static_shadow_[cascade];
+        }
+        main_.clear_color = pack_srgb(glm::vec3(MAIN_CLEAR_COLOR));
+    }
+
+    void SoftwareRenderDevice::resize_main_frame(uint16_t width, uint16_t height) {
+        if (width == main_.width && height == main_.height) {
+            return;
+        }
+
+        main_ = create_target(width, height, true);
+        main_.clear_color = pack_srgb(glm::vec3(MAIN_CLEAR_COLOR));
+    }
+
+    SoftwareRenderDevice::Target SoftwareRenderDevice::create_target(uint16_t width, uint16_t height, bool has_color) {
+        assert(width % TILE_WIDTH == 0 && "Software target width must be a multiple of the tile width");
+
+        Target target = {
+            .width = width,
+            .height = height,
+            .tiles_x = static_cast<uint16_t>((width + TILE_WIDTH - 1) / TILE_WIDTH),
+            .tiles_y = static_cast<uint16_t>((height + TILE_HEIGHT - 1) / TILE_HEIGHT),
+        };
+        target.depth.resize(width * height, 1.0f);
+        if (has_color) {
+            target.color.resize(width * height);
+        }
+        target.bins.resize(target.tiles_x * target.tiles_y);
+        return target;
+    }
+
+    void SoftwareRenderDevice::begin_frame() {
+        NullRenderDevice::begin_frame();
+        target_ = nullptr;
+        light_clusters_ = nullptr;
+    }
+
+    void SoftwareRenderDevice::end_frame() {
+        flush();
+    }
+
+    std::optional<MeshRange> SoftwareRenderDevice::allocate_mesh(const Mesh& mesh) {
+        const std::optional<MeshRange> range = NullRenderDevice::allocate_mesh(mesh);
+        if (!range.has_value()) {
+            return {};
+        }
+
+        // Grown on demand, the arena limits are enforced by the allocators
+        mesh_vertices_.resize(std::max<size_t>(mesh_vertices_.size(), range->first_vertex + range->vertex_count));
+        mesh_indices_.resize(std::max<size_t>(mesh_indices_.size(), range->first_index + range->index_count));
+        std::copy(mesh.vertices.begin(), mesh.vertices.end(), mesh_vertices_.begin() + range->first_vertex);
+        std::copy(mesh.indices.begin(), mesh.indices.end(), mesh_indices_.begin() + range->first_index);
+
+        return range;
+    }
+
+    ProgramId SoftwareRenderDevice::create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) {
+        Program program = Program::Unsupported;
+        if (vertex_shader_name == "depth.vert.glsl") {
+            program = Program::Depth;
+        } else if (vertex_shader_name == "toon.vert.glsl") {
+            program = Program::Toon;
+        } else {
+            spdlog::warn("No software version of {}, its draws are skipped", vertex_shader_name);
+        }
+
+        programs_.push_back(program);
+        return static_cast<ProgramId>(programs_.size() - 1);
+    }
+
+    void SoftwareRenderDevice::begin_pass(RenderPass pass) {
+        // The previous pass must be done before its target is read
+        flush();
+
+        if (is_static_shadow_pass(pass)) {
+            cascade_ = get_shadow_cascade(pass);
+            target_ = &static_shadow_[cascade_];
+        } else if (is_shadow_pass(pass)) {
+            cascade_ = get_shadow_cascade(pass);
+            target_ = &shadow_[cascade_];
+        } else if (pass == RenderPass::Main) {
+            target_ = &main_;
+        } else {
+            target_ = nullptr;
+            return;
+        }
+        target_->clear_pending = true;
+    }
+
+    void SoftwareRenderDevice::bind_frame_uniforms(const StreamAllocation& uniforms) {
+        std::memcpy(&uniforms_, uniforms.data, sizeof(FrameUniforms));
+    }
+
+    void SoftwareRenderDevice::bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) {
+        point_lights_ = static_cast<const GpuPointLight*>(lights.data);
+        point_light_count_ = lights.size / sizeof(GpuPointLight);
+        light_clusters_ = clusters.size >= static_cast<GLsizeiptr>(LIGHT_CLUSTER_COUNT * sizeof(GpuLightCluster))
+                              ? static_cast<const GpuLightCluster*>(clusters.data)
+                              : nullptr;
+        light_indices_ = static_cast<const uint32_t*>(indices.data);
+        light_index_count_ = indices.size / sizeof(uint32_t);
+    }
+
+    void SoftwareRenderDevice::use_program(ProgramId program) {
+        assert(program < programs_.size() && "Unknown program");
+        program_ = programs_[program];
+    }
+
+    void SoftwareRenderDevice::multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) {
+        if (!target_ || program_ == Program::Unsupported) {
+            return;
+        }
+
+        const auto* indirect = static_cast<const DrawElementsIndirectCommand*>(commands.data) + first;
+        const auto* instances = reinterpret_cast<const InstanceData*>(get_stream_memory());
+        const glm::mat4 view_projection = uniforms_.projection * uniforms_.view;
+
+        for (size_t c = 0; c < count; c++) {
+            const DrawElementsIndirectCommand& command = indirect[c];
+            const uint32_t* indices = mesh_indices_.data() + command.first_index;
+
+            // Indices are relative to the base vertex, only the referenced vertices are transformed
+            uint32_t vertex_count = 0;
+            for (uint32_t i = 0; i < command.count; i++) {
+                vertex_count = std::max(vertex_count, indices[i] + 1);
+            }
+            const Vertex* vertices = mesh_vertices_.data() + command.base_vertex;
+            clip_vertices_.resize(vertex_count);
+
+            for (uint32_t instance_index = 0; instance_index < command.instance_count; instance_index++) {
+                const InstanceData& instance = instances[command.base_instance + instance_index];
+
+                if (program_ == Program::Depth) {
+                    const glm::mat4 model_light = uniforms_.cascade_matrices[cascade_] * instance.model;
+                    for (uint32_t v = 0; v < vertex_count; v++) {
+                        clip_vertices_[v].clip = model_light * glm::vec4(vertices[v].position, 1.0f);
+                    }
+                } else {
+                    const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+                    for (uint32_t v = 0; v < vertex_count; v++) {
+                        const glm::vec4 world = instance.model * glm::vec4(vertices[v].position, 1.0f);
+                        clip_vertices_[v] = {
+                            .clip = view_projection * world,
+                            .varyings = {
+                                .position = glm::vec3(world),
+                                .normal = glm::normalize(normal_matrix * vertices[v].normal),
+                                .color = glm::vec3(instance.color),
+                            },
+                        };
+                    }
+                }
+
+                for (uint32_t i = 0; i + 2 < command.count; i += 3) {
+                    add_triangle(clip_vertices_[indices[i]], clip_vertices_[indices[i + 1]], clip_vertices_[indices[i + 2]]);
+                }
+            }
+        }
+    }
+
+    void SoftwareRenderDevice::add_triangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+        // Entirely outside one of the side planes
+        for (int axis = 0; axis < 2; axis++) {
+            if ((a.clip[axis] > a.clip.w && b.clip[axis] > b.clip.w && c.clip[axis] > c.clip.w) ||
+                (a.clip[axis] < -a.clip.w && b.clip[axis] < -b.clip.w && c.clip[axis] < -c.clip.w)) {
+                return;
+            }
+        }
+
+        auto lerp_vertex = [](const ClipVertex& from, const ClipVertex& to, float_t t) -> ClipVertex {
+            const Varyings& v0 = from.varyings;
+            const Varyings& v1 = to.varyings;
+            return {
+                .clip = from.clip + (to.clip - from.clip) * t,
+                .varyings = {
+                    .position = v0.position + (v1.position - v0.position) * t,
+                    .normal = v0.normal + (v1.normal - v0.normal) * t,
+                    .color = v0.color + (v1.color - v0.color) * t,
+                },
+            };
+        };
+
+        // Only the near plane is clipped, the rest is handled by the pixel bounds and the depth test
+        const std::array<const ClipVertex*, 3> input = {&a, &b, &c};
+        std::array<ClipVertex, 4> output;
+        size_t output_count = 0;
+        for (size_t i = 0; i < 3; i++) {
+            const ClipVertex& current = *input[i];
+            const ClipVertex& next = *input[(i + 1) % 3];
+            const float_t current_distance = current.clip.z + current.clip.w;
+            const float_t next_distance = next.clip.z + next.clip.w;
+
+            if (current_distance >= 0.0f) {
+                output[output_count++] = current;
+            }
+            if ((current_distance >= 0.0f) != (next_distance >= 0.0f)) {
+                const float_t t = current_distance / (current_distance - next_distance);
+                output[output_count++] = lerp_vertex(current, next, t);
+            }
+        }
+
+        for (size_t i = 1; i + 1 < output_count; i++) {
+            add_clipped_triangle(output[0], output[i], output[i + 1]);
+        }
+    }
+
+    void SoftwareRenderDevice::add_clipped_triangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+        const std::array<const ClipVertex*, 3> vertices = {&a, &b, &c};
+
+        Triangle triangle = {.program = program_};
+        std::array<glm::vec2, 3> screen;
+        for (size_t i = 0; i < 3; i++) {
+            const glm::vec4& clip = vertices[i]->clip;
+            const float_t inv_w = 1.0f / clip.w;
+            screen[i] = glm::vec2((clip.x * inv_w * 0.5f + 0.5f) * target_->width, (clip.y * inv_w * 0.5f + 0.5f) * target_->height);
+            triangle.depth[i] = clip.z * inv_w * 0.5f + 0.5f;
+            triangle.inv_w[i] = inv_w;
+
+            const Varyings& varyings = vertices[i]->varyings;
+            triangle.varyings[i] = {
+                .position = varyings.position * inv_w,
+                .normal = varyings.normal * inv_w,
+                .color = varyings.color * inv_w,
+            };
+        }
+
+        // Counter clockwise triangles face the camera, back faces are culled in both passes like on GL
+        const float_t area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        if (!(area > 0.0f)) {
+            return;
+        }
+        triangle.inv_area = 1.0f / area;
+
+        for (size_t e = 0; e < 3; e++) {
+            const EdgeFunction edge = setup_edge(screen[e], screen[(e + 1) % 3]);
+            triangle.edge_a[e] = edge.a;
+            triangle.edge_b[e] = edge.b;
+            triangle.edge_c[e] = edge.c;
+            triangle.edge_inclusive[e] = edge.inclusive;
+        }
+
+        const glm::vec2 min = glm::min(screen[0], glm::min(screen[1], screen[2]));
+        const glm::vec2 max = glm::max(screen[0], glm::max(screen[1], screen[2]));
+        triangle.min_pixel = glm::max(glm::ivec2(glm::floor(min)), glm::ivec2(0));
+        triangle.max_pixel = glm::min(glm::ivec2(glm::floor(max)), glm::ivec2(target_->width - 1, target_->height - 1));
+        if (triangle.min_pixel.x > triangle.max_pixel.x || triangle.min_pixel.y > triangle.max_pixel.y) {
+            return;
+        }
+
+        const uint32_t index = static_cast<uint32_t>(triangles_.size());
+        triangles_.push_back(triangle);
+
+        for (int32_t ty = triangle.min_pixel.y / TILE_HEIGHT; ty <= triangle.max_pixel.y / TILE_HEIGHT; ty++) {
+            for (int32_t tx = triangle.min_pixel.x / TILE_WIDTH; tx <= triangle.max_pixel.x / TILE_WIDTH; tx++) {
+                target_->bins[ty * target_->tiles_x + tx].push_back(index);
+            }
+        }
+    }
+
+    void SoftwareRenderDevice::flush() {
+        if (!target_) {
+            return;
+        }
+
+        // Tiles are independent and keep the submission order of their triangles
+        const size_t tile_count = target_->bins.size();
+        if (pool_) {
+            pool_->parallel_for(tile_count, 1, [this](size_t begin, size_t end) {
+                for (size_t tile = begin; tile < end; tile++) {
+                    rasterize_tile(tile);
+                }
+            });
+        } else {
+            for (size_t tile = 0; tile < tile_count; tile++) {
+                rasterize_tile(tile);
+            }
+        }
+
+        target_->clear_pending = false;
+        triangles_.clear();
+    }
+
+    void SoftwareRenderDevice::rasterize_tile(size_t tile) {
+        Target& target = *target_;
+        const int32_t tile_x0 = static_cast<int32_t>(tile % target.tiles_x) * TILE_WIDTH;
+        const int32_t tile_y0 = static_cast<int32_t>(tile / target.tiles_x) * TILE_HEIGHT;
+        const int32_t tile_x1 = std::min<int32_t>(tile_x0 + TILE_WIDTH, target.width);
+        const int32_t tile_y1 = std::min<int32_t>(tile_y0 + TILE_HEIGHT, target.height);
+
+        if (target.clear_pending) {
+            for (int32_t y = tile_y0; y < tile_y1; y++) {
+                const size_t row = y * target.width;
+                if (target.clear_source) {
+                    std::copy(target.clear_source->depth.begin() + row + tile_x0, target.clear_source->depth.begin() + row + tile_x1, target.depth.begin() + row + tile_x0);
+                } else {
+                    std::fill(target.depth.begin() + row + tile_x0, target.depth.begin() + row + tile_x1, 1.0f);
+                }
+                if (!target.color.empty()) {
+                    std::fill(target.color.begin() + row + tile_x0, target.color.begin() + row + tile_x1, target.clear_color);
+                }
+            }
+        }
+
+        std::vector<uint32_t>& bin = target.bins[tile];
+        for (auto index : bin) {
+            const Triangle& triangle = triangles_[index];
+            const bool has_color = triangle.program == Program::Toon && !target.color.empty();
+
+            // Groups of 4 pixels stay inside the tile since tiles are 4 aligned
+            const int32_t x0 = std::max(triangle.min_pixel.x, tile_x0) & ~3;
+            const int32_t x1 = std::min(triangle.max_pixel.x + 1, tile_x1);
+            const int32_t y0 = std::max(triangle.min_pixel.y, tile_y0);
+            const int32_t y1 = std::min(triangle.max_pixel.y + 1, tile_y1);
+
+            for (int32_t y = y0; y < y1; y++) {
+                const float_t py = static_cast<float_t>(y) + 0.5f;
+                float_t* depth_row = target.depth.data() + y * target.width;
+                uint32_t* color_row = has_color ? target.color.data() + y * target.width : nullptr;
+
+#if defined(__SSE2__)
+                const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 inv_area = _mm_set1_ps(triangle.inv_area);
+                __m128 row_edge[3], step_edge[3], inclusive[3];
+                for (int e = 0; e < 3; e++) {
+                    row_edge[e] = _mm_set1_ps(triangle.edge_b[e] * py + triangle.edge_c[e]);
+                    step_edge[e] = _mm_set1_ps(triangle.edge_a[e]);
+                    inclusive[e] = _mm_castsi128_ps(_mm_set1_epi32(triangle.edge_inclusive[e] ? -1 : 0));
+                }
+
+                for (int32_t x = x0; x < x1; x += 4) {
+                    const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float_t>(x)), offsets);
+
+                    __m128 edge[3];
+                    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++) {
+                        edge[e] = _mm_add_ps(_mm_mul_ps(step_edge[e], px), row_edge[e]);
+                        const __m128 inside = _mm_or_ps(_mm_cmpgt_ps(edge[e], zero), _mm_and_ps(_mm_cmpeq_ps(edge[e], zero), inclusive[e]));
+                        mask = _mm_and_ps(mask, inside);
+                    }
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+
+                    // Edge e is opposite to vertex e + 2
+                    const __m128 w0 = _mm_mul_ps(edge[1], inv_area);
+                    const __m128 w1 = _mm_mul_ps(edge[2], inv_area);
+                    const __m128 w2 = _mm_mul_ps(edge[0], inv_area);
+                    const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(triangle.depth[0])),
+                                                           _mm_mul_ps(w1, _mm_set1_ps(triangle.depth[1]))),
+                                                _mm_mul_ps(w2, _mm_set1_ps(triangle.depth[2])));
+                    const __m128 current = _mm_loadu_ps(depth_row + x);
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, current));
+
+                    const int lanes = _mm_movemask_ps(mask);
+                    if (lanes == 0) {
+                        continue;
+                    }
+                    _mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, current)));
+
+                    if (has_color) {
+                        alignas(16) float_t weights[3][4];
+                        _mm_store_ps(weights[0], w0);
+                        _mm_store_ps(weights[1], w1);
+                        _mm_store_ps(weights[2], w2);
+                        for (int lane = 0; lane < 4; lane++) {
+                            if (lanes & (1 << lane)) {
+                                color_row[x + lane] = shade_toon(triangle, glm::vec3(weights[0][lane], weights[1][lane], weights[2][lane]),
+                                                                 glm::vec2(static_cast<float_t>(x + lane) + 0.5f, py));
+                            }
+                        }
+                    }
+                }
+#else
+                for (int32_t x = x0; x < x1; x++) {
+                    const float_t px = static_cast<float_t>(x) + 0.5f;
+
+                    float_t edge[3];
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) {
+                        edge[e] = triangle.edge_a[e] * px + (triangle.edge_b[e] * py + triangle.edge_c[e]);
+                        inside &= edge[e] > 0.0f || (edge[e] == 0.0f && triangle.edge_inclusive[e]);
+                    }
+                    if (!inside) {
+                        continue;
+                    }
+
+                    // Edge e is opposite to vertex e + 2
+                    const glm::vec3 weights = glm::vec3(edge[1], edge[2], edge[0]) * triangle.inv_area;
+                    const float_t z = weights[0] * triangle.depth[0] + weights[1] * triangle.depth[1] + weights[2] * triangle.depth[2];
+                    if (!(z < depth_row[x])) {
+                        continue;
+                    }
+                    depth_row[x] = z;
+
+                    if (has_color) {
+                        color_row[x] = shade_toon(triangle, weights, glm::vec2(px, py));
+                    }
+                }
+#endif
+            }
+        }
+
+        bin.clear();
+    }
+
+    uint32_t SoftwareRenderDevice::shade_toon(const Triangle& triangle, const glm::vec3& weights, const glm::vec2& pixel) const {
+        // Perspective correct varyings, they are already divided by w
+        const float_t w = 1.0f / glm::dot(weights, triangle.inv_w);
+        const auto& v = triangle.varyings;
+        const glm::vec3 position = (v[0].position * weights[0] + v[1].position * weights[1] + v[2].position * weights[2]) * w;
+        const glm::vec3 normal = (v[0].normal * weights[0] + v[1].normal * weights[1] + v[2].normal * weights[2]) * w;
+        const glm::vec3 color = (v[0].color * weights[0] + v[1].color * weights[1] + v[2].color * weights[2]) * w;
+
+        // Mirrors toon.frag.glsl
+        const glm::vec3 view_dir = glm::normalize(uniforms_.view_pos - position);
+        const float_t view_depth = -(uniforms_.view * glm::vec4(position, 1.0f)).z;
+        glm::vec3 result = AMBIENT * color;
+
+        // Directional light
+        {
+            const GpuDirectionalLight& light = uniforms_.dir_light;
+            const glm::vec3 l = glm::normalize(light.dir);
+            const glm::vec3 h = glm::normalize(view_dir + l);
+
+            const float_t n_dot_l = std::max(glm::dot(normal, l), 0.0f);
+            const float_t diffuse = smoothstep(0.0f, 0.01f, n_dot_l);
+
+            const float_t n_dot_h = std::max(glm::dot(normal, h), 0.0f);
+            const float_t specular = smoothstep(0.39f, 0.4f, std::pow(n_dot_h * diffuse, 64.0f));
+
+            const float_t rim_dot = 1.0f - std::max(glm::dot(normal, view_dir), 0.0f);
+            const float_t rim = smoothstep(0.746f, 0.766f, rim_dot * std::pow(n_dot_l, 0.1f));
+
+            // First cascade reaching past the pixel, the last one covers the rest
+            uint32_t cascade = SHADOW_CASCADE_COUNT - 1;
+            for (uint32_t i = 0; i + 1 < SHADOW_CASCADE_COUNT; i++) {
+                if (view_depth < uniforms_.cascade_splits[i]) {
+                    cascade = i;
+                    break;
+                }
+            }
+            const Target& shadow_map = shadow_[cascade];
+
+            // Nearest lookup in the repeating shadow map
+            const glm::vec4 light_space = uniforms_.cascade_matrices[cascade] * glm::vec4(position, 1.0f);
+            const glm::vec3 projected = glm::vec3(light_space) / light_space.w * 0.5f + 0.5f;
+            const float_t u = projected.x - std::floor(projected.x);
+            const float_t t = projected.y - std::floor(projected.y);
+            const int32_t texel_x = std::min<int32_t>(static_cast<int32_t>(u * shadow_map.width), shadow_map.width - 1);
+            const int32_t texel_y = std::min<int32_t>(static_cast<int32_t>(t * shadow_map.height), shadow_map.height - 1);
+            const float_t closest = shadow_map.depth[texel_y * shadow_map.width + texel_x];
+            const float_t shadow = projected.z - SHADOW_BIAS > closest ? 1.0f : 0.0f;
+
+            const glm::vec3 lit = light.col * (diffuse * light.intensity) + light.col * (specular * light.intensity) + light.col * rim;
+            result += lit * (1.0f - shadow) * color;
+        }
+
+        if (!light_clusters_) {
+            return pack_srgb(result);
+        }
+
+        // Only the lights of the pixel's cluster, like getLightCluster in lights.glsl
+        const glm::vec4& params = uniforms_.cluster_params;
+        const uint32_t tile_x = std::min(static_cast<uint32_t>(pixel.x * params.x), LIGHT_CLUSTER_GRID_X - 1);
+        const uint32_t tile_y = std::min(static_cast<uint32_t>(pixel.y * params.y), LIGHT_CLUSTER_GRID_Y - 1);
+        const float_t slice = std::log(std::max(view_depth, 1e-4f)) * params.z + params.w;
+        const uint32_t tile_z = static_cast<uint32_t>(std::clamp(slice, 0.0f, static_cast<float_t>(LIGHT_CLUSTER_GRID_Z - 1)));
+        const GpuLightCluster& cluster = light_clusters_[(tile_z * LIGHT_CLUSTER_GRID_Y + tile_y) * LIGHT_CLUSTER_GRID_X + tile_x];
+
+        for (uint32_t i = 0; i < cluster.count && cluster.offset + i < light_index_count_; i++) {
+            const uint32_t index = light_indices_[cluster.offset + i];
+            if (index >= point_light_count_) {
+                continue;
+            }
+            const GpuPointLight& light = point_lights_[index];
+            const glm::vec3 l = glm::normalize(light.pos - position);
+            const float_t n_dot_l = std::max(0.0f, glm::dot(normal, l));
+            const float_t distance = glm::length(light.pos - position);
+            const float_t window = std::clamp(1.0f - std::pow(distance / light.range, 4.0f), 0.0f, 1.0f);
+            const float_t attenuation = window * window / (1.0f + distance * distance);
+            result += light.col * light.intensity * color * (attenuation * n_dot_l);
+        }
+
+        return pack_srgb(result);
+    }
+
+    void SoftwareRenderDevice::present(uint16_t width, uint16_t height) {
+        flush();
+        target_ = nullptr;
+
+        // Nearest scale of the main target, like the GL blit
+        image_width_ = width;
+        image_height_ = height;
+        image_.resize(width * height);
+        for (uint32_t y = 0; y < height; y++) {
+            const uint32_t source_y = y * main_.height / height;
+            for (uint32_t x = 0; x < width; x++) {
+                image_[y * width + x] = main_.color[source_y * main_.width + x * main_.width / width];
+            }
+        }
+    }
+
+    void SoftwareRenderDevice::draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) {
+        if (image_width_ != width || image_height_ != height) {
+            return;
+        }
+
+        const auto* strip = static_cast<const TrailVertex*>(vertices.data);
+        auto to_pixel = [&](const glm::vec2& point) {
+            return glm::vec2((point.x * 0.5f + 0.5f) * width, (point.y * 0.5f + 0.5f) * height);
+        };
+        auto edge = [](const glm::vec2& a, const glm::vec2& b, const glm::vec2& point) {
+            return (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+        };
+
+        // Pixel centers of each strip triangle, either winding, blended like GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA.
+        // Edges shared by consecutive triangles are owned by one of them, so no pixel is blended twice
+        for (uint32_t i = 0; i + 2 < count; i++) {
+            std::array<glm::vec2, 3> corners = {to_pixel(strip[i].position), to_pixel(strip[i + 1].position), to_pixel(strip[i + 2].position)};
+            std::array<float_t, 3> alphas = {strip[i].alpha, strip[i + 1].alpha, strip[i + 2].alpha};
+            float_t area = edge(corners[0], corners[1], corners[2]);
+            if (std::abs(area) < 1e-6f) {
+                continue;
+            }
+            // Every other strip triangle is clockwise
+            if (area < 0.0f) {
+                std::swap(corners[1], corners[2]);
+                std::swap(alphas[1], alphas[2]);
+                area = -area;
+            }
+            const std::array<EdgeFunction, 3> edges = {setup_edge(corners[0], corners[1]), setup_edge(corners[1], corners[2]),
+                                                       setup_edge(corners[2], corners[0])};
+
+            const glm::vec2 min_corner = glm::min(glm::min(corners[0], corners[1]), corners[2]);
+            const glm::vec2 max_corner = glm::max(glm::max(corners[0], corners[1]), corners[2]);
+            const int32_t x0 = std::max(static_cast<int32_t>(std::floor(min_corner.x)), 0);
+            const int32_t y0 = std::max(static_cast<int32_t>(std::floor(min_corner.y)), 0);
+            const int32_t x1 = std::min(static_cast<int32_t>(std::ceil(max_corner.x)), static_cast<int32_t>(width) - 1);
+            const int32_t y1 = std::min(static_cast<int32_t>(std::ceil(max_corner.y)), static_cast<int32_t>(height) - 1);
+
+            for (int32_t y = y0; y <= y1; y++) {
+                for (int32_t x = x0; x <= x1; x++) {
+                    const glm::vec2 center(x + 0.5f, y + 0.5f);
+                    if (!edges[0].contains(center) || !edges[1].contains(center) || !edges[2].contains(center)) {
+                        continue;
+                    }
+
+                    const float_t w0 = std::max(edges[1].evaluate(center) / area, 0.0f);
+                    const float_t w1 = std::max(edges[2].evaluate(center) / area, 0.0f);
+                    const float_t w2 = std::max(1.0f - w0 - w1, 0.0f);
+                    const float_t alpha = w0 * alphas[0] + w1 * alphas[1] + w2 * alphas[2];
+                    uint32_t& pixel = image_[y * width + x];
+                    uint32_t blended = 0xff000000u;
+                    for (uint32_t shift = 0; shift < 24; shift += 8) {
+                        const float_t destination = static_cast<float_t>((pixel >> shift) & 0xff);
+                        const float_t source = static_cast<float_t>((TRAIL_COLOR >> shift) & 0xff);
+                        blended |= static_cast<uint32_t>(destination + (source - destination) * alpha + 0.5f) << shift;
+                    }
+                    pixel = blended;
+                }
+            }
+        }
+    }
+
+    bool SoftwareRenderDevice::write_ppm(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            spdlog::error("Could not open {} for writing", path);
+            return false;
+        }
+
+        file << "P6\n" << image_width_ << " " << image_height_ << "\n255\n";
+        // PPM rows go top to bottom
+        for (int32_t y = image_height_ - 1; y >= 0; y--) {
+            for (uint32_t x = 0; x < image_width_; x++) {
+                const uint32_t pixel = image_[y * image_width_ + x];
+                const char rgb[3] = {static_cast<char>(pixel & 0xff), static_cast<char>((pixel >> 8) & 0xff), static_cast<char>((pixel >> 16) & 0xff)};
+                file.write(rgb, 3);
+            }
+        }
+        return static_cast<bool>(file);
+    }
+
+} // namespace leper
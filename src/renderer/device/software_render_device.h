@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "null_render_device.h"
+#include "../frame_uniforms.h"
+#include "../lighting/light_clusters.h"
+#include "../../utils/thread_pool.h"
+
+namespace leper {
+
+    // CPU implementation of the depth, toon and trail programs, for headless golden images
+    // and machines without usable GL. Draws transform and bin their triangles into screen
+    // tiles, and each pass is then rasterized tile by tile on the pool, four pixels at a time
+    class SoftwareRenderDevice : public NullRenderDevice {
+      public:
+        explicit SoftwareRenderDevice(ThreadPool* pool = nullptr);
+
+        void begin_frame() override;
+        void end_frame() override;
+
+        std::optional<MeshRange> allocate_mesh(const Mesh& mesh) override;
+
+        // Programs are matched to their CPU version by vertex shader name
+        ProgramId create_program(const std::string& vertex_shader_name, const std::string& fragment_shader_name) override;
+
+        void resize_main_frame(uint16_t width, uint16_t height) override;
+
+        void begin_pass(RenderPass pass) override;
+        void bind_frame_uniforms(const StreamAllocation& uniforms) override;
+        void bind_light_clusters(const StreamAllocation& lights, const StreamAllocation& clusters, const StreamAllocation& indices) override;
+        void use_program(ProgramId program) override;
+        void multi_draw_indirect(const StreamAllocation& commands, size_t first, size_t count) override;
+        void present(uint16_t width, uint16_t height) override;
+        void draw_screen_ribbon(const StreamAllocation& vertices, uint32_t count, uint16_t width, uint16_t height) override;
+
+        // Last presented image as sRGB encoded RGBA8, bottom row first like GL
+        const std::vector<uint32_t>& get_image() const { return image_; }
+        uint16_t get_image_width() const { return image_width_; }
+        uint16_t get_image_height() const { return image_height_; }
+        // Binary PPM of the last presented image
+        bool write_ppm(const std::string& path) const;
+
+      private:
+        enum class Program : uint8_t {
+            Depth,
+            Toon,
+            Unsupported,
+        };
+
+        // Outputs of toon.vert.glsl
+        struct Varyings {
+            glm::vec3 position;
+            glm::vec3 normal;
+            glm::vec3 color;
+        };
+
+        struct ClipVertex {
+            glm::vec4 clip;
+            Varyings varyings;
+        };
+
+        struct Triangle {
+            // Edge functions a * x + b * y + c of the edges starting at each vertex, positive inside.
+            // Edges shared by two triangles are evaluated identically by both, up to the sign
+            std::array<float_t, 3> edge_a;
+            std::array<float_t, 3> edge_b;
+            std::array<float_t, 3> edge_c;
+            // Whether pixels exactly on the edge belong to this triangle, exactly one side owns them
+            std::array<bool, 3> edge_inclusive;
+            float_t inv_area;
+            // [0, 1] window depth and 1 / w of each vertex
+            glm::vec3 depth;
+            glm::vec3 inv_w;
+            glm::ivec2 min_pixel;
+            glm::ivec2 max_pixel;
+            Program program;
+            // Divided by w, for perspective correct interpolation
+            std::array<Varyings, 3> varyings;
+        };
+
+        struct Target {
+            uint16_t width = 0;
+            uint16_t height = 0;
+            uint16_t tiles_x = 0;
+            uint16_t tiles_y = 0;
+            std::vector<float_t> depth;
+            // Empty for depth only targets
+            std::vector<uint32_t> color;
+            uint32_t clear_color = 0;
+            // Copied instead of clearing when set
+            const Target* clear_source = nullptr;
+            std::vector<std::vector<uint32_t>> bins;
+            bool clear_pending = false;
+        };
+
+        static Target create_target(uint16_t width, uint16_t height, bool has_color);
+
+        void add_triangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c);
+        void add_clipped_triangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c);
+        // Rasterizes every binned triangle of the current target
+        void flush();
+        void rasterize_tile(size_t tile);
+        // Pixel is the window position of the pixel center, like gl_FragCoord
+        uint32_t shade_toon(const Triangle& triangle, const glm::vec3& weights, const glm::vec2& pixel) const;
+
+        ThreadPool* pool_;
+
+        std::vector<Vertex> mesh_vertices_;
+        std::vector<uint32_t> mesh_indices_;
+
+        std::vector<Program> programs_;
+        Program program_ = Program::Unsupported;
+        FrameUniforms uniforms_ = {};
+        // In the stream memory, valid until the next frame
+        const GpuPointLight* point_lights_ = nullptr;
+        size_t point_light_count_ = 0;
+        const GpuLightCluster* light_clusters_ = nullptr;
+        const uint32_t* light_indices_ = nullptr;
+        size_t light_index_count_ = 0;
+
+        // One per cascade
+        std::array<Target, SHADOW_CASCADE_COUNT> shadow_;
+        std::array<Target, SHADOW_CASCADE_COUNT> static_shadow_;
+        uint32_t cascade_ = 0;
+        Target main_;
+        Target* target_ = nullptr;
+        std::vector<Triangle> triangles_;
+        std::vector<ClipVertex> clip_vertices_;
+
+        std::vector<uint32_t> image_;
+        uint16_t image_width_ = 0;
+        uint16_t image_height_ = 0;
+    };
+
+} // namespace leper
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "leper/leper_rendering_constants.h"
+
+namespace leper {
+
+    // Mirrors of the std140 blocks in resources/shaders/frame.glsl and the std430 ones in lights.glsl
+    // vec3 members are followed by a scalar so they fill a full 16 bytes slot
+
+    struct GpuDirectionalLight {
+        glm::vec3 dir = glm::vec3(0.0f);
+        float intensity = 0.0f;
+        glm::vec3 col = glm::vec3(0.0f);
+        float padding = 0.0f;
+    };
+
+    // Element of the point light storage buffer, the range bounds the light for clustering
+    struct GpuPointLight {
+        glm::vec3 pos = glm::vec3(0.0f);
+        float intensity = 0.0f;
+        glm::vec3 col = glm::vec3(0.0f);
+        float range = 0.0f;
+        float falloff = 0.0f;
+        float padding[3] = {};
+    };
+
+    struct FrameUniforms {
+        glm::mat4 projection = glm::mat4(1.0f);
+        glm::mat4 view = glm::mat4(1.0f);
+        // World to shadow map clip space of each cascade
+        std::array<glm::mat4, SHADOW_CASCADE_COUNT> cascade_matrices = {};
+        // View space distance where each cascade ends
+        glm::vec4 cascade_splits = glm::vec4(0.0f);
+        glm::vec3 view_pos = glm::vec3(0.0f);
+        float padding = 0.0f;
+        GpuDirectionalLight dir_light = {};
+        // Fragment to light cluster mapping, see LightClusters::get_params
+        glm::vec4 cluster_params = glm::vec4(0.0f);
+    };
+
+    // Bound by the device for each shadow pass
+    struct ShadowPassUniforms {
+        uint32_t cascade = 0;
+        uint32_t padding[3] = {};
+    };
+
+    static_assert(SHADOW_CASCADE_COUNT <= 4, "Cascade splits are packed in a vec4");
+    static_assert(sizeof(GpuDirectionalLight) == 32, "std140 struct size is rounded to 16 bytes");
+    static_assert(sizeof(GpuPointLight) == 48, "std430 array stride of PointLight");
+    static_assert(offsetof(FrameUniforms, view) == 64);
+    static_assert(offsetof(FrameUniforms, cascade_matrices) == 128);
+    static_assert(offsetof(FrameUniforms, cascade_splits) == 128 + 64 * SHADOW_CASCADE_COUNT);
+    static_assert(offsetof(FrameUniforms, view_pos) == 144 + 64 * SHADOW_CASCADE_COUNT);
+    static_assert(offsetof(FrameUniforms, dir_light) == 160 + 64 * SHADOW_CASCADE_COUNT);
+    static_assert(offsetof(FrameUniforms, cluster_params) == 192 + 64 * SHADOW_CASCADE_COUNT);
+    static_assert(sizeof(FrameUniforms) == 208 + 64 * SHADOW_CASCADE_COUNT);
+    static_assert(sizeof(ShadowPassUniforms) == 16, "std140 block size is rounded to 16 bytes");
+
+} // namespace leper
@@ -0,0 +1,162 @@
+#include "gl_state_cache.h"
+
+#include <cassert>
+
+namespace leper {
+
+    static int32_t get_buffer_slot(GLenum target) {
+        switch (target) {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_SHADER_STORAGE_BUFFER:
+            return 3;
+        case GL_DRAW_INDIRECT_BUFFER:
+            return 4;
+        default:
+            return -1;
+        }
+    }
+
+    static GLenum get_capability_enum(GlCapability capability) {
+        switch (capability) {
+        case GlCapability::DepthTest:
+            return GL_DEPTH_TEST;
+        case GlCapability::CullFace:
+            return GL_CULL_FACE;
+        case GlCapability::FramebufferSrgb:
+            return GL_FRAMEBUFFER_SRGB;
+        case GlCapability::Blend:
+            return GL_BLEND;
+        default:
+            assert(false && "Unknown GL capability");
+            return GL_NONE;
+        }
+    }
+
+    GlStateCache::GlStateCache() {
+        invalidate();
+    }
+
+    void GlStateCache::invalidate() {
+        program_ = UNKNOWN;
+        vertex_array_ = UNKNOWN;
+        buffers_.fill(UNKNOWN);
+        draw_framebuffer_ = UNKNOWN;
+        read_framebuffer_ = UNKNOWN;
+        viewport_.fill(-1);
+        enabled_.fill(-1);
+        active_texture_unit_ = UNKNOWN;
+        textures_.fill(UNKNOWN);
+    }
+
+    void GlStateCache::use_program(GLuint program) {
+        if (update(program_, program)) {
+            glUseProgram(program);
+        }
+    }
+
+    void GlStateCache::bind_vertex_array(GLuint vao) {
+        if (update(vertex_array_, vao)) {
+            glBindVertexArray(vao);
+            // The element buffer binding is part of the VAO
+            buffers_[get_buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    }
+
+    void GlStateCache::bind_buffer(GLenum target, GLuint buffer) {
+        const int32_t slot = get_buffer_slot(target);
+        if (slot < 0) {
+            stats_.issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+
+        if (update(buffers_[slot], buffer)) {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    void GlStateCache::bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+        // Indexed bindings are not tracked
+        stats_.issued++;
+        glBindBufferBase(target, index, buffer);
+
+        const int32_t slot = get_buffer_slot(target);
+        if (slot >= 0) {
+            buffers_[slot] = buffer;
+        }
+    }
+
+    void GlStateCache::bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        // Streamed ranges move every frame, so these are not worth tracking
+        stats_.issued++;
+        glBindBufferRange(target, index, buffer, offset, size);
+
+        const int32_t slot = get_buffer_slot(target);
+        if (slot >= 0) {
+            buffers_[slot] = buffer;
+        }
+    }
+
+    void GlStateCache::bind_framebuffer(GLenum target, GLuint framebuffer) {
+        switch (target) {
+        case GL_DRAW_FRAMEBUFFER:
+            if (update(draw_framebuffer_, framebuffer)) {
+                glBindFramebuffer(target, framebuffer);
+            }
+            break;
+        case GL_READ_FRAMEBUFFER:
+            if (update(read_framebuffer_, framebuffer)) {
+                glBindFramebuffer(target, framebuffer);
+            }
+            break;
+        default:
+            if (draw_framebuffer_ == framebuffer && read_framebuffer_ == framebuffer) {
+                stats_.skipped++;
+                return;
+            }
+            draw_framebuffer_ = framebuffer;
+            read_framebuffer_ = framebuffer;
+            stats_.issued++;
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            break;
+        }
+    }
+
+    void GlStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        if (update(viewport_, std::array<GLint, 4>{x, y, width, height})) {
+            glViewport(x, y, width, height);
+        }
+    }
+
+    void GlStateCache::set_enabled(GlCapability capability, bool enabled) {
+        if (update(enabled_[static_cast<size_t>(capability)], static_cast<int8_t>(enabled))) {
+            if (enabled) {
+                glEnable(get_capability_enum(capability));
+            } else {
+                glDisable(get_capability_enum(capability));
+            }
+        }
+    }
+
+    void GlStateCache::bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+        assert(unit < MAX_TEXTURE_UNITS && "Texture unit out of range");
+
+        if (textures_[unit] == texture) {
+            stats_.skipped++;
+            return;
+        }
+
+        if (update(active_texture_unit_, static_cast<GLuint>(unit))) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+        textures_[unit] = texture;
+        stats_.issued++;
+        glBindTexture(target, texture);
+    }
+
+} // namespace leper
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace leper {
+
+    enum class GlCapability : uint8_t {
+        DepthTest,
+        CullFace,
+        FramebufferSrgb,
+        Blend,
+        Count,
+    };
+
+    struct GlStateStats {
+        uint32_t issued = 0;
+        uint32_t skipped = 0;
+    };
+
+    // Shadows the GL state the renderer touches and drops calls that would not change it
+    // Every state change has to go through this once it is in use, or the cache must be invalidated
+    class GlStateCache {
+      public:
+        GlStateCache();
+
+        // Forgets everything, the next call of each kind is always issued
+        void invalidate();
+
+        void use_program(GLuint program);
+        void bind_vertex_array(GLuint vao);
+        void bind_buffer(GLenum target, GLuint buffer);
+        // Also binds the buffer to the generic target
+        void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+        void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+        // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+        void bind_framebuffer(GLenum target, GLuint framebuffer);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+        void set_enabled(GlCapability capability, bool enabled);
+        // Assumes a unit is only ever used with one texture target
+        void bind_texture(uint32_t unit, GLenum target, GLuint texture);
+
+        void reset_stats() { stats_ = {}; }
+        const GlStateStats& get_stats() const { return stats_; }
+
+      private:
+        static constexpr GLuint UNKNOWN = ~0u;
+        static constexpr size_t BUFFER_TARGET_COUNT = 5;
+        static constexpr size_t MAX_TEXTURE_UNITS = 16;
+
+        // Updates the cached value and returns whether the call has to be issued
+        template <typename T>
+        bool update(T& cached, T value) {
+            if (cached == value) {
+                stats_.skipped++;
+                return false;
+            }
+            cached = value;
+            stats_.issued++;
+            return true;
+        }
+
+        GLuint program_;
+        GLuint vertex_array_;
+        std::array<GLuint, BUFFER_TARGET_COUNT> buffers_;
+        GLuint draw_framebuffer_;
+        GLuint read_framebuffer_;
+        std::array<GLint, 4> viewport_;
+        // -1 when unknown
+        std::array<int8_t, static_cast<size_t>(GlCapability::Count)> enabled_;
+        GLuint active_texture_unit_;
+        std::array<GLuint, MAX_TEXTURE_UNITS> textures_;
+
+        GlStateStats stats_ = {};
+    };
+
+} // namespace leper
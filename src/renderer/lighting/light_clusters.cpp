@@ -0,0 +1,236 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <spdlog/spdlog.h>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace leper {
+
+    static_assert(MAX_POINT_LIGHTS <= std::numeric_limits<uint16_t>::max(), "Cluster light slots are 16 bits");
+
+    // Logarithmic slices need a positive near distance
+    constexpr float_t MIN_CLUSTER_DEPTH = 0.05f;
+
+    LightClusters::LightClusters() {
+        for (auto* bounds : {&min_x_, &min_y_, &min_z_, &max_x_, &max_y_, &max_z_}) {
+            bounds->resize(LIGHT_CLUSTER_COUNT);
+        }
+        cluster_lights_.resize(LIGHT_CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        clusters_.resize(LIGHT_CLUSTER_COUNT);
+        indices_.resize(LIGHT_CLUSTER_INDEX_CAPACITY);
+    }
+
+    void LightClusters::build_cluster_bounds(const glm::mat4& projection) {
+        projection_ = projection;
+        const glm::mat4 inverse_projection = glm::inverse(projection);
+
+        auto unproject = [&](float_t x, float_t y, float_t z) {
+            const glm::vec4 view = inverse_projection * glm::vec4(x, y, z, 1.0f);
+            return glm::vec3(view) / view.w;
+        };
+        auto get_ndc_depth = [&](float_t distance) {
+            const glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+            return clip.z / clip.w;
+        };
+
+        near_ = std::max(-unproject(0.0f, 0.0f, -1.0f).z, MIN_CLUSTER_DEPTH);
+        far_ = std::max(-unproject(0.0f, 0.0f, 1.0f).z, 2.0f * near_);
+
+        // Slice k spans near * (far / near)^(k / Z) to near * (far / near)^((k + 1) / Z)
+        const float_t log_ratio = std::log(far_ / near_);
+        const float_t slices = static_cast<float_t>(LIGHT_CLUSTER_GRID_Z);
+        params_.z = slices / log_ratio;
+        params_.w = -slices * std::log(near_) / log_ratio;
+
+        for (uint32_t slice = 0; slice < LIGHT_CLUSTER_GRID_Z; slice++) {
+            const float_t slice_near = near_ * std::pow(far_ / near_, static_cast<float_t>(slice) / LIGHT_CLUSTER_GRID_Z);
+            const float_t slice_far = near_ * std::pow(far_ / near_, static_cast<float_t>(slice + 1) / LIGHT_CLUSTER_GRID_Z);
+            const float_t depths[2] = {get_ndc_depth(slice_near), get_ndc_depth(slice_far)};
+
+            for (uint32_t y = 0; y < LIGHT_CLUSTER_GRID_Y; y++) {
+                const float_t ys[2] = {-1.0f + 2.0f * y / LIGHT_CLUSTER_GRID_Y, -1.0f + 2.0f * (y + 1) / LIGHT_CLUSTER_GRID_Y};
+                for (uint32_t x = 0; x < LIGHT_CLUSTER_GRID_X; x++) {
+                    const float_t xs[2] = {-1.0f + 2.0f * x / LIGHT_CLUSTER_GRID_X, -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTER_GRID_X};
+
+                    glm::vec3 min = glm::vec3(std::numeric_limits<float_t>::max());
+                    glm::vec3 max = glm::vec3(std::numeric_limits<float_t>::lowest());
+                    for (int corner = 0; corner < 8; corner++) {
+                        const glm::vec3 point = unproject(xs[corner & 1], ys[(corner >> 1) & 1], depths[corner >> 2]);
+                        min = glm::min(min, point);
+                        max = glm::max(max, point);
+                    }
+
+                    const size_t cluster = (slice * LIGHT_CLUSTER_GRID_Y + y) * LIGHT_CLUSTER_GRID_X + x;
+                    min_x_[cluster] = min.x;
+                    min_y_[cluster] = min.y;
+                    min_z_[cluster] = min.z;
+                    max_x_[cluster] = max.x;
+                    max_y_[cluster] = max.y;
+                    max_z_[cluster] = max.z;
+                }
+            }
+        }
+    }
+
+    void LightClusters::build(const glm::mat4& view, const glm::mat4& projection, uint16_t width, uint16_t height,
+                              const std::vector<GpuPointLight>& lights, ThreadPool* pool) {
+        if (projection != projection_) {
+            build_cluster_bounds(projection);
+        }
+        params_.x = static_cast<float_t>(LIGHT_CLUSTER_GRID_X) / width;
+        params_.y = static_cast<float_t>(LIGHT_CLUSTER_GRID_Y) / height;
+
+        auto get_slice = [&](float_t depth) {
+            const float_t slice = std::log(std::max(depth, near_)) * params_.z + params_.w;
+            return std::clamp(static_cast<int32_t>(slice), 0, static_cast<int32_t>(LIGHT_CLUSTER_GRID_Z - 1));
+        };
+        auto get_tile = [](float_t ndc, uint32_t tiles) {
+            return std::clamp(static_cast<int32_t>(std::floor((ndc * 0.5f + 0.5f) * tiles)), 0, static_cast<int32_t>(tiles - 1));
+        };
+
+        // Lights in view space with the clusters under their bounds
+        view_lights_.clear();
+        const size_t light_count = std::min(lights.size(), MAX_POINT_LIGHTS);
+        for (size_t i = 0; i < light_count; i++) {
+            const GpuPointLight& light = lights[i];
+            const glm::vec3 center = glm::vec3(view * glm::vec4(light.pos, 1.0f));
+            const float_t depth = -center.z;
+            if (light.range <= 0.0f || depth + light.range < near_ || depth - light.range > far_) {
+                continue;
+            }
+
+            // Screen bounds of the box around the sphere, the whole screen when it reaches behind the camera
+            glm::vec2 ndc_min = glm::vec2(-1.0f);
+            glm::vec2 ndc_max = glm::vec2(1.0f);
+            bool is_projected = true;
+            glm::vec2 projected_min = glm::vec2(std::numeric_limits<float_t>::max());
+            glm::vec2 projected_max = glm::vec2(std::numeric_limits<float_t>::lowest());
+            for (int corner = 0; corner < 8 && is_projected; corner++) {
+                const glm::vec3 offset = glm::vec3(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f);
+                const glm::vec4 clip = projection * glm::vec4(center + offset * light.range, 1.0f);
+                if (clip.w <= 1e-5f) {
+                    is_projected = false;
+                    break;
+                }
+                projected_min = glm::min(projected_min, glm::vec2(clip) / clip.w);
+                projected_max = glm::max(projected_max, glm::vec2(clip) / clip.w);
+            }
+            if (is_projected) {
+                if (projected_max.x < -1.0f || projected_max.y < -1.0f || projected_min.x > 1.0f || projected_min.y > 1.0f) {
+                    continue;
+                }
+                ndc_min = projected_min;
+                ndc_max = projected_max;
+            }
+
+            view_lights_.push_back({
+                .center = center,
+                .radius = light.range,
+                .index = static_cast<uint16_t>(i),
+                .min_cluster = glm::ivec3(get_tile(ndc_min.x, LIGHT_CLUSTER_GRID_X), get_tile(ndc_min.y, LIGHT_CLUSTER_GRID_Y), get_slice(depth - light.range)),
+                .max_cluster = glm::ivec3(get_tile(ndc_max.x, LIGHT_CLUSTER_GRID_X), get_tile(ndc_max.y, LIGHT_CLUSTER_GRID_Y), get_slice(depth + light.range)),
+            });
+        }
+
+        if (pool) {
+            pool->parallel_for(LIGHT_CLUSTER_GRID_Z, 1, [this](size_t begin, size_t end) {
+                for (size_t slice = begin; slice < end; slice++) {
+                    assign_slice(static_cast<uint32_t>(slice));
+                }
+            });
+        } else {
+            for (uint32_t slice = 0; slice < LIGHT_CLUSTER_GRID_Z; slice++) {
+                assign_slice(slice);
+            }
+        }
+
+        // Compact the per cluster slots into one index list
+        index_count_ = 0;
+        bool is_truncated = false;
+        for (uint32_t cluster = 0; cluster < LIGHT_CLUSTER_COUNT; cluster++) {
+            GpuLightCluster& lights_of_cluster = clusters_[cluster];
+            if (lights_of_cluster.count > LIGHT_CLUSTER_INDEX_CAPACITY - index_count_) {
+                lights_of_cluster.count = LIGHT_CLUSTER_INDEX_CAPACITY - index_count_;
+                is_truncated = true;
+            }
+
+            lights_of_cluster.offset = index_count_;
+            const uint16_t* slots = cluster_lights_.data() + cluster * MAX_LIGHTS_PER_CLUSTER;
+            std::copy(slots, slots + lights_of_cluster.count, indices_.begin() + index_count_);
+            index_count_ += lights_of_cluster.count;
+        }
+
+        if (is_truncated) {
+            spdlog::warn("Light cluster index list is full, dropping lights");
+        }
+    }
+
+    void LightClusters::assign_slice(uint32_t slice) {
+        const size_t slice_first = slice * LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y;
+        for (size_t cluster = slice_first; cluster < slice_first + LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y; cluster++) {
+            clusters_[cluster].count = 0;
+        }
+
+        // Lights past the per cluster limit are dropped, lower indices win
+        auto add_light = [&](size_t cluster, uint16_t light) {
+            uint32_t& count = clusters_[cluster].count;
+            if (count < MAX_LIGHTS_PER_CLUSTER) {
+                cluster_lights_[cluster * MAX_LIGHTS_PER_CLUSTER + count++] = light;
+            }
+        };
+
+        for (const auto& light : view_lights_) {
+            if (static_cast<int32_t>(slice) < light.min_cluster.z || static_cast<int32_t>(slice) > light.max_cluster.z) {
+                continue;
+            }
+            const float_t radius_squared = light.radius * light.radius;
+
+            for (int32_t y = light.min_cluster.y; y <= light.max_cluster.y; y++) {
+                const size_t row = slice_first + y * LIGHT_CLUSTER_GRID_X;
+                int32_t x = light.min_cluster.x;
+
+#if defined(__SSE2__)
+                // Squared distance from the center to four boxes at once
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 center_x = _mm_set1_ps(light.center.x);
+                const __m128 center_y = _mm_set1_ps(light.center.y);
+                const __m128 center_z = _mm_set1_ps(light.center.z);
+                const __m128 radius = _mm_set1_ps(radius_squared);
+                auto axis_distance = [&](const float_t* min, const float_t* max, __m128 center) {
+                    const __m128 distance = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min), center), _mm_sub_ps(center, _mm_loadu_ps(max))));
+                    return _mm_mul_ps(distance, distance);
+                };
+
+                for (; x + 3 <= light.max_cluster.x; x += 4) {
+                    const size_t first = row + x;
+                    const __m128 distance = _mm_add_ps(_mm_add_ps(axis_distance(&min_x_[first], &max_x_[first], center_x),
+                                                                  axis_distance(&min_y_[first], &max_y_[first], center_y)),
+                                                       axis_distance(&min_z_[first], &max_z_[first], center_z));
+                    const int inside = _mm_movemask_ps(_mm_cmple_ps(distance, radius));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (inside & (1 << lane)) {
+                            add_light(first + lane, light.index);
+                        }
+                    }
+                }
+#endif
+                for (; x <= light.max_cluster.x; x++) {
+                    const size_t cluster = row + x;
+                    const glm::vec3 min = glm::vec3(min_x_[cluster], min_y_[cluster], min_z_[cluster]);
+                    const glm::vec3 max = glm::vec3(max_x_[cluster], max_y_[cluster], max_z_[cluster]);
+                    const glm::vec3 distance = glm::max(glm::vec3(0.0f), glm::max(min - light.center, light.center - max));
+                    if (glm::dot(distance, distance) <= radius_squared) {
+                        add_light(cluster, light.index);
+                    }
+                }
+            }
+        }
+    }
+
+} // namespace leper
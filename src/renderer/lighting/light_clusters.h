@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_rendering_constants.h"
+#include "../frame_uniforms.h"
+#include "../../utils/thread_pool.h"
+
+namespace leper {
+
+    // Light list of one cluster in the index buffer, mirrors uvec2 in lights.glsl
+    struct GpuLightCluster {
+        uint32_t offset = 0;
+        uint32_t count = 0;
+    };
+
+    constexpr uint32_t LIGHT_CLUSTER_COUNT = LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y * LIGHT_CLUSTER_GRID_Z;
+
+    // CPU clustered light assignment. The view frustum is split into screen tiles and
+    // logarithmic depth slices, and every cluster gets the compact list of the point
+    // lights whose sphere of influence touches its view space box.
+    //
+    // Slices are independent and built in parallel, each light only visiting the clusters
+    // under its projected bounds, four clusters of a row at a time
+    class LightClusters {
+      public:
+        LightClusters();
+
+        // Lights are in world space, the size is the main target's the clusters are looked up in.
+        // Cluster boxes are only rebuilt when the projection changes
+        void build(const glm::mat4& view, const glm::mat4& projection, uint16_t width, uint16_t height,
+                   const std::vector<GpuPointLight>& lights, ThreadPool* pool = nullptr);
+
+        // Maps a fragment to its cluster: x and y scale window coordinates of the main target
+        // into tiles, the slice is log(view depth) * z + w
+        const glm::vec4& get_params() const { return params_; }
+        const std::vector<GpuLightCluster>& get_clusters() const { return clusters_; }
+        // Only the first get_index_count() entries are used
+        const std::vector<uint32_t>& get_indices() const { return indices_; }
+        uint32_t get_index_count() const { return index_count_; }
+
+      private:
+        struct ViewLight {
+            glm::vec3 center;
+            float_t radius;
+            uint16_t index;
+            glm::ivec3 min_cluster;
+            glm::ivec3 max_cluster;
+        };
+
+        void build_cluster_bounds(const glm::mat4& projection);
+        void assign_slice(uint32_t slice);
+
+        glm::mat4 projection_ = glm::mat4(0.0f);
+        float_t near_ = 0.0f;
+        float_t far_ = 0.0f;
+        glm::vec4 params_ = glm::vec4(0.0f);
+
+        // View space boxes, structure of arrays in cluster order
+        std::vector<float_t> min_x_, min_y_, min_z_;
+        std::vector<float_t> max_x_, max_y_, max_z_;
+
+        std::vector<ViewLight> view_lights_;
+        // MAX_LIGHTS_PER_CLUSTER slots per cluster before compaction
+        std::vector<uint16_t> cluster_lights_;
+        std::vector<GpuLightCluster> clusters_;
+        std::vector<uint32_t> indices_;
+        uint32_t index_count_ = 0;
+    };
+
+} // namespace leper
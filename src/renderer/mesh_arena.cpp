@@ -0,0 +1,68 @@
+#include "mesh_arena.h"
+
+#include <cstddef>
+#include <spdlog/spdlog.h>
+
+namespace leper {
+
+    MeshArena::MeshArena(uint32_t vertex_capacity, uint32_t index_capacity)
+        : vertices_(vertex_capacity), indices_(index_capacity) {
+
+        glCreateBuffers(1, &vertex_buffer_);
+        glNamedBufferStorage(vertex_buffer_, vertex_capacity * sizeof(Vertex), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &index_buffer_);
+        glNamedBufferStorage(index_buffer_, index_capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+        glCreateVertexArrays(1, &vao_);
+        glVertexArrayVertexBuffer(vao_, VERTEX_BINDING, vertex_buffer_, 0, sizeof(Vertex));
+        glVertexArrayElementBuffer(vao_, index_buffer_);
+
+        glEnableVertexArrayAttrib(vao_, 0);
+        glVertexArrayAttribFormat(vao_, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+        glVertexArrayAttribBinding(vao_, 0, VERTEX_BINDING);
+
+        glEnableVertexArrayAttrib(vao_, 1);
+        glVertexArrayAttribFormat(vao_, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+        glVertexArrayAttribBinding(vao_, 1, VERTEX_BINDING);
+    }
+
+    MeshArena::~MeshArena() {
+        glDeleteVertexArrays(1, &vao_);
+        glDeleteBuffers(1, &vertex_buffer_);
+        glDeleteBuffers(1, &index_buffer_);
+    }
+
+    std::optional<MeshRange> MeshArena::allocate(const Mesh& mesh) {
+        const uint32_t vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        const uint32_t index_count = static_cast<uint32_t>(mesh.indices.size());
+
+        const std::optional<uint32_t> first_vertex = vertices_.allocate(vertex_count);
+        if (!first_vertex.has_value()) {
+            spdlog::error("Mesh arena has no room for the {} vertices of {}", vertex_count, mesh.name);
+            return {};
+        }
+
+        const std::optional<uint32_t> first_index = indices_.allocate(index_count);
+        if (!first_index.has_value()) {
+            spdlog::error("Mesh arena has no room for the {} indices of {}", index_count, mesh.name);
+            vertices_.free(first_vertex.value(), vertex_count);
+            return {};
+        }
+
+        glNamedBufferSubData(vertex_buffer_, first_vertex.value() * sizeof(Vertex), vertex_count * sizeof(Vertex), mesh.vertices.data());
+        glNamedBufferSubData(index_buffer_, first_index.value() * sizeof(uint32_t), index_count * sizeof(uint32_t), mesh.indices.data());
+
+        return MeshRange{
+            .first_index = first_index.value(),
+            .index_count = index_count,
+            .first_vertex = first_vertex.value(),
+            .vertex_count = vertex_count,
+        };
+    }
+
+    void MeshArena::free(const MeshRange& range) {
+        vertices_.free(range.first_vertex, range.vertex_count);
+        indices_.free(range.first_index, range.index_count);
+    }
+
+} // namespace leper
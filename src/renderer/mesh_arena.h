@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <glad/glad.h>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_rendering_types.h"
+#include "../utils/free_list_allocator.h"
+
+namespace leper {
+
+    // One vertex buffer and one index buffer shared by every static mesh behind a single VAO
+    // Indices are local to their mesh, draws pass first_vertex as the base vertex
+    class MeshArena {
+      public:
+        // Binding 0 of the VAO holds the vertices, the others are free for the caller
+        static constexpr GLuint VERTEX_BINDING = 0;
+
+        MeshArena(uint32_t vertex_capacity, uint32_t index_capacity);
+        ~MeshArena();
+
+        MeshArena(const MeshArena&) = delete;
+        MeshArena& operator=(const MeshArena&) = delete;
+
+        // Returns nothing when the arena has no room left for the mesh
+        std::optional<MeshRange> allocate(const Mesh& mesh);
+        void free(const MeshRange& range);
+
+        GLuint get_vao() const { return vao_; }
+
+      private:
+        GLuint vao_ = 0;
+        GLuint vertex_buffer_ = 0;
+        GLuint index_buffer_ = 0;
+
+        FreeListAllocator vertices_;
+        FreeListAllocator indices_;
+    };
+
+} // namespace leper
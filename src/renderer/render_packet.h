@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_rendering_constants.h"
+#include "frame_uniforms.h"
+#include "render_queue.h"
+#include "lighting/light_clusters.h"
+#include "trail/trail_ribbon.h"
+
+namespace leper {
+
+    // Mesh uploaded by the submit before anything is drawn, the handle comes back with the packet
+    struct MeshUpload {
+        // Caller defined, tells where the handle goes
+        uint32_t owner = 0;
+        // Moved in by the caller, the submit leaves it untouched
+        Mesh mesh;
+        MeshHandle handle = {};
+    };
+
+    // Everything Renderer::submit needs for one frame. Built without touching the device,
+    // so the next packet can be filled while the previous one is submitted
+    struct RenderPacket {
+        RenderQueue queue = RenderQueue(MAX_RENDER_COMMANDS);
+        FrameUniforms uniforms = {};
+        std::vector<GpuPointLight> point_lights;
+        LightClusters light_clusters;
+        // One bit per cascade whose static shadow is redrawn
+        uint32_t static_shadow_refreshes = 0;
+        // Written back: the refreshes that were drawn with every caster. The others were skipped
+        // or cut short, because the depth program was still building or a stream or the queue was full
+        uint32_t refreshed_static_shadows = 0;
+
+        // Screen size, the frame is rendered at the main size and scaled to it
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint16_t main_width = MAIN_FRAME_WIDTH;
+        uint16_t main_height = MAIN_FRAME_HEIGHT;
+        // Tessellated into a ribbon over the presented frame
+        TrailPoints trail;
+
+        std::vector<MeshUpload> mesh_uploads;
+        bool reload_shaders = false;
+
+        // Written back by the render thread, CPU time of the submit including waits on the GPU
+        float_t submit_milliseconds = 0.0f;
+    };
+
+} // namespace leper
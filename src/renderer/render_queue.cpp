@@ -0,0 +1,118 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <spdlog/spdlog.h>
+
+namespace leper {
+
+    constexpr uint64_t DEPTH_BITS = 24;
+
+    RenderPass get_static_shadow_pass(uint32_t cascade) {
+        assert(cascade < SHADOW_CASCADE_COUNT && "Shadow cascade out of range");
+        return static_cast<RenderPass>(static_cast<uint8_t>(RenderPass::StaticShadow) + cascade);
+    }
+
+    RenderPass get_shadow_pass(uint32_t cascade) {
+        assert(cascade < SHADOW_CASCADE_COUNT && "Shadow cascade out of range");
+        return static_cast<RenderPass>(static_cast<uint8_t>(RenderPass::Shadow) + cascade);
+    }
+
+    bool is_static_shadow_pass(RenderPass pass) {
+        return pass >= RenderPass::StaticShadow && pass <= RenderPass::StaticShadowLast;
+    }
+
+    bool is_shadow_pass(RenderPass pass) {
+        return pass >= RenderPass::Shadow && pass <= RenderPass::ShadowLast;
+    }
+
+    uint32_t get_shadow_cascade(RenderPass pass) {
+        if (is_static_shadow_pass(pass)) {
+            return static_cast<uint32_t>(pass) - static_cast<uint32_t>(RenderPass::StaticShadow);
+        }
+        assert(is_shadow_pass(pass) && "Not a shadow pass");
+        return static_cast<uint32_t>(pass) - static_cast<uint32_t>(RenderPass::Shadow);
+    }
+
+    uint64_t make_sort_key(RenderPass pass, uint8_t shader_id, uint16_t mesh_id, float_t depth) {
+        const uint64_t max_depth = (1ull << DEPTH_BITS) - 1;
+        const uint64_t quantized_depth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float_t>(max_depth));
+
+        return (static_cast<uint64_t>(pass) << 60) |
+               (static_cast<uint64_t>(shader_id) << 52) |
+               (static_cast<uint64_t>(mesh_id) << 36) |
+               (quantized_depth << 12);
+    }
+
+    RenderPass get_render_pass(uint64_t key) {
+        return static_cast<RenderPass>(key >> 60);
+    }
+
+    uint64_t get_batch_key(uint64_t key) {
+        return key >> 36;
+    }
+
+    RenderQueue::RenderQueue(size_t capacity) {
+        commands_.resize(capacity);
+        scratch_.resize(capacity);
+        items_.resize(capacity);
+    }
+
+    void RenderQueue::clear() {
+        count_.store(0, std::memory_order_relaxed);
+    }
+
+    void RenderQueue::push(uint64_t key, const DrawItem& item) {
+        const size_t index = count_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= commands_.size()) {
+            spdlog::warn("Render queue is full, dropping a draw");
+            return;
+        }
+
+        items_[index] = item;
+        commands_[index] = {.key = key, .item = static_cast<uint32_t>(index)};
+    }
+
+    void RenderQueue::sort() {
+        const size_t count = size();
+
+        // All 8 histograms in a single read of the keys
+        std::array<std::array<uint32_t, 256>, 8> histograms = {};
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t key = commands_[i].key;
+            for (size_t byte = 0; byte < 8; byte++) {
+                histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+            }
+        }
+
+        RenderCommand* src = commands_.data();
+        RenderCommand* dst = scratch_.data();
+
+        for (size_t byte = 0; byte < 8; byte++) {
+            auto& histogram = histograms[byte];
+
+            // Every key has the same value for this byte
+            if (count == 0 || histogram[(src[0].key >> (byte * 8)) & 0xFF] == count) {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (auto& bucket : histogram) {
+                const uint32_t bucket_count = bucket;
+                bucket = offset;
+                offset += bucket_count;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                dst[histogram[(src[i].key >> (byte * 8)) & 0xFF]++] = src[i];
+            }
+            std::swap(src, dst);
+        }
+
+        if (src != commands_.data()) {
+            std::copy(src, src + count, commands_.data());
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_rendering_constants.h"
+
+namespace leper {
+
+    // Passes run in this order
+    enum class RenderPass : uint8_t {
+        // Cached shadow of the static casters, one pass per cascade. Only run when the cache is refreshed
+        StaticShadow = 0,
+        StaticShadowLast = StaticShadow + SHADOW_CASCADE_COUNT - 1,
+        // One pass per shadow cascade, Shadow + i renders cascade i on top of its static cache
+        Shadow,
+        ShadowLast = Shadow + SHADOW_CASCADE_COUNT - 1,
+        Main,
+        Count,
+    };
+
+    struct DrawItem {
+        glm::mat4 model;
+        // Linear albedo, unused by the shadow pass
+        glm::vec3 color;
+        MeshHandle mesh;
+        ShaderHandle shader;
+    };
+
+    // Per instance vertex attributes, streamed once per frame in sorted command order
+    struct InstanceData {
+        glm::mat4 model;
+        glm::vec4 color;
+    };
+
+    struct RenderStats {
+        uint32_t draw_calls = 0;
+        // Indirect commands, one per mesh and shader run
+        uint32_t batches = 0;
+        uint32_t instances = 0;
+        uint32_t shader_binds = 0;
+        uint32_t vao_binds = 0;
+    };
+
+    struct RenderCommand {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    // From the most to the least significant bits:
+    // pass (4) | shader (8) | mesh (16) | depth (24) | unused (12)
+    // so sorting groups state changes first and goes front to back within a group
+    RenderPass get_static_shadow_pass(uint32_t cascade);
+    RenderPass get_shadow_pass(uint32_t cascade);
+    bool is_static_shadow_pass(RenderPass pass);
+    bool is_shadow_pass(RenderPass pass);
+    // Cascade rendered by a static or dynamic shadow pass
+    uint32_t get_shadow_cascade(RenderPass pass);
+
+    uint64_t make_sort_key(RenderPass pass, uint8_t shader_id, uint16_t mesh_id, float_t depth);
+    RenderPass get_render_pass(uint64_t key);
+    // Commands with the same batch key share a pass, shader and mesh and can be drawn instanced
+    uint64_t get_batch_key(uint64_t key);
+
+    // Fixed capacity per frame buffer of draws. Pushing is thread safe and never allocates
+    class RenderQueue {
+      public:
+        explicit RenderQueue(size_t capacity);
+
+        void clear();
+        // Drops the command when the queue is full
+        void push(uint64_t key, const DrawItem& item);
+        // LSD radix sort on the keys, skipping the bytes all the keys share
+        void sort();
+
+        size_t size() const { return std::min(count_.load(std::memory_order_relaxed), commands_.size()); }
+        // Some pushes since the last clear found the queue full
+        bool has_dropped() const { return count_.load(std::memory_order_relaxed) > commands_.size(); }
+        const RenderCommand& get_command(size_t index) const { return commands_[index]; }
+        const DrawItem& get_item(uint32_t index) const { return items_[index]; }
+
+      private:
+        std::vector<RenderCommand> commands_;
+        std::vector<RenderCommand> scratch_;
+        std::vector<DrawItem> items_;
+        std::atomic<size_t> count_ = 0;
+    };
+
+} // namespace leper
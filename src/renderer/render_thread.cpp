@@ -0,0 +1,52 @@
+#include "render_thread.h"
+
+#include <cassert>
+#include <chrono>
+
+namespace leper {
+
+    RenderThread::RenderThread(Renderer* renderer, RenderThreadCallbacks callbacks)
+        : renderer_(renderer), callbacks_(std::move(callbacks)) {
+        assert(renderer_ && "RenderThread needs a renderer");
+
+        // Queued before the thread exists, so no other producer can race these
+        for (RenderPacket& packet : packets_) {
+            completed_.push(&packet);
+        }
+        thread_ = std::thread(&RenderThread::run, this);
+    }
+
+    RenderThread::~RenderThread() {
+        submitted_.push(nullptr);
+        thread_.join();
+    }
+
+    RenderPacket& RenderThread::acquire_packet() {
+        return *completed_.pop();
+    }
+
+    void RenderThread::submit(RenderPacket& packet) {
+        submitted_.push(&packet);
+    }
+
+    void RenderThread::run() {
+        if (callbacks_.on_start) {
+            callbacks_.on_start();
+        }
+
+        while (RenderPacket* packet = submitted_.pop()) {
+            const auto start = std::chrono::steady_clock::now();
+            renderer_->submit(*packet);
+            packet->submit_milliseconds = std::chrono::duration<float_t, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (callbacks_.on_frame) {
+                callbacks_.on_frame();
+            }
+            completed_.push(packet);
+        }
+
+        if (callbacks_.on_stop) {
+            callbacks_.on_stop();
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <functional>
+#include <thread>
+
+#include "leper/leper_rendering_constants.h"
+#include "render_packet.h"
+#include "renderer.h"
+#include "../utils/spsc_queue.h"
+
+namespace leper {
+
+    // Hooks run on the render thread
+    struct RenderThreadCallbacks {
+        // Before the first packet, e.g. to make the GL context current
+        std::function<void()> on_start;
+        // After each submitted packet, e.g. to swap buffers
+        std::function<void()> on_frame;
+        // Before the thread exits, e.g. to release the GL context
+        std::function<void()> on_stop;
+    };
+
+    // Moves a renderer to a thread of its own. From construction to destruction the renderer
+    // and its device belong to the render thread, and the creating thread only talks to it
+    // through packets. Destruction submits what is still queued and hands the renderer back
+    class RenderThread {
+      public:
+        explicit RenderThread(Renderer* renderer, RenderThreadCallbacks callbacks = {});
+        ~RenderThread();
+
+        RenderThread(const RenderThread&) = delete;
+        RenderThread& operator=(const RenderThread&) = delete;
+
+        // Oldest packet the render thread is done with. Waits while RENDER_THREAD_QUEUE_DEPTH
+        // packets are queued or being submitted
+        RenderPacket& acquire_packet();
+        // Queues an acquired packet, it belongs to the render thread until acquired again
+        void submit(RenderPacket& packet);
+
+      private:
+        // One more than the queue depth, for the packet being built
+        static constexpr size_t PACKET_COUNT = RENDER_THREAD_QUEUE_DEPTH + 1;
+        // Room for every packet and the stop request
+        static constexpr size_t QUEUE_CAPACITY = std::bit_ceil(PACKET_COUNT + 1);
+
+        void run();
+
+        Renderer* renderer_;
+        RenderThreadCallbacks callbacks_;
+        std::array<RenderPacket, PACKET_COUNT> packets_;
+
+        // Game thread to render thread, nullptr stops the thread
+        SpscQueue<RenderPacket*, QUEUE_CAPACITY> submitted_;
+        // Render thread back to the game thread
+        SpscQueue<RenderPacket*, QUEUE_CAPACITY> completed_;
+
+        std::thread thread_;
+    };
+
+} // namespace leper
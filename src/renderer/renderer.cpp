@@ -1,222 +1,242 @@
 #include "renderer.h"
 
-#include <glad/glad.h>
-#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <optional>
 #include <spdlog/spdlog.h>
-#include <GLFW/glfw3.h>
 
 #include "leper/leper_rendering_constants.h"
 
 namespace leper {
 
-    Renderer::Renderer() {
-        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-            spdlog::error("Failed to initalize GLAD");
-        }
-        init_main_frame();
-        init_shadow_map();
-        init_trail();
-        depth_shader_ = std::make_unique<Shader>("depth.vert.glsl", "depth.frag.glsl");
-        trail_shader_ = std::make_unique<Shader>("trail.vert.glsl", "trail.frag.glsl");
+    Renderer::Renderer(std::unique_ptr<RenderDevice> device) : device_(std::move(device)) {
+        assert(device_ && "Renderer needs a device");
+        depth_shader_ = shaders_.insert(device_->create_program("depth.vert.glsl", "depth.frag.glsl"));
     }
 
-    void Renderer::init_main_frame() {
-        glGenFramebuffers(1, &main_fbo_);
-        glBindFramebuffer(GL_FRAMEBUFFER, main_fbo_);
-
-        // Color
-        glGenTextures(1, &main_texture_);
-        glBindTexture(GL_TEXTURE_2D, main_texture_);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, MAIN_FRAME_WIDTH, MAIN_FRAME_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        // Depth
-        glGenRenderbuffers(1, &main_depth_rbo_);
-        glBindRenderbuffer(GL_RENDERBUFFER, main_depth_rbo_);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, MAIN_FRAME_WIDTH, MAIN_FRAME_HEIGHT);
-
-        // Attach
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, main_texture_, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, main_depth_rbo_);
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            spdlog::error("Framebuffer is not complete!");
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    void Renderer::begin_frame() {
+        stats_ = {};
+        static_shadow_refreshes_ = 0;
+        completed_static_shadows_ = 0;
+        device_->begin_frame();
     }
 
-    void Renderer::init_shadow_map() {
-        glGenFramebuffers(1, &shadow_map_fbo_);
-
-        glGenTextures(1, &shadow_map_);
-        glBindTexture(GL_TEXTURE_2D, shadow_map_);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-                     SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, shadow_map_fbo_);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_map_, 0);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            spdlog::error("Shadow map framebuffer is not complete!");
-        }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    void Renderer::end_frame() {
+        device_->end_frame();
     }
 
-    void Renderer::init_trail() {
-        glGenVertexArrays(1, &trail_vao_);
-        glGenBuffers(1, &trail_vbo_);
-
-        glBindVertexArray(trail_vao_);
-        glBindBuffer(GL_ARRAY_BUFFER, trail_vbo_);
-        glBufferData(GL_ARRAY_BUFFER, 64 * sizeof(glm::vec2), nullptr, GL_DYNAMIC_DRAW); // allocate space
-
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+    void Renderer::finish_main_frame(uint16_t width, uint16_t height) {
+        device_->present(width, height);
     }
 
-    void Renderer::start_shadow_frame() {
-        glBindFramebuffer(GL_FRAMEBUFFER, shadow_map_fbo_);
-        glViewport(0, 0, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
+    void Renderer::submit(RenderPacket& packet) {
+        if (packet.reload_shaders) {
+            reload_shaders();
+        }
+        for (MeshUpload& upload : packet.mesh_uploads) {
+            upload.handle = upload_mesh(upload.mesh);
+        }
+        device_->resize_main_frame(packet.main_width, packet.main_height);
+
+        begin_frame();
+        const bool has_uniforms = update_frame_uniforms(packet.uniforms);
+        // Without the light matrices or the depth program the cached content is kept as it is
+        if (has_uniforms && device_->is_program_ready(*shaders_.get(depth_shader_))) {
+            for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+                if (packet.static_shadow_refreshes & (1u << cascade)) {
+                    refresh_static_shadow(cascade);
+                }
+            }
+        }
 
-        glClear(GL_DEPTH_BUFFER_BIT);
+        update_light_clusters(packet.point_lights, packet.light_clusters);
+        execute(packet.queue);
+        packet.refreshed_static_shadows = completed_static_shadows_;
 
-        glEnable(GL_DEPTH_TEST);
+        finish_main_frame(packet.width, packet.height);
+        draw_trail(packet.width, packet.height, packet.trail);
+        end_frame();
     }
 
-    void Renderer::start_main_frame() {
-        glBindFramebuffer(GL_FRAMEBUFFER, main_fbo_);
-        glViewport(0, 0, MAIN_FRAME_WIDTH, MAIN_FRAME_HEIGHT);
+    MeshHandle Renderer::upload_mesh(const Mesh& mesh) {
+        assert(!mesh.indices.empty() && "Meshes are drawn indexed");
 
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Move this in dedicated methods
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_FRAMEBUFFER_SRGB);
+        const std::optional<MeshRange> range = device_->allocate_mesh(mesh);
+        if (!range.has_value()) {
+            return {};
+        }
 
-        glBindTexture(GL_TEXTURE_2D, shadow_map_);
+        return meshes_.insert({.range = range.value()});
     }
 
-    void Renderer::finish_main_frame(uint16_t width, uint16_t height) {
-        // Set default framebuffer to screen
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, main_fbo_);
-
-        glBlitFramebuffer(0, 0, MAIN_FRAME_WIDTH, MAIN_FRAME_HEIGHT,
-                          0, 0, width, height,
-                          GL_COLOR_BUFFER_BIT,
-                          GL_NEAREST);
+    void Renderer::unload_mesh(MeshHandle mesh) {
+        const MeshGlObjetcs* objects = meshes_.get(mesh);
+        if (!objects) {
+            spdlog::warn("Tried to unload a stale mesh handle");
+            return;
+        }
 
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        device_->free_mesh(objects->range);
+        meshes_.remove(mesh);
     }
 
-    bool Renderer::has_mesh_objects(const Mesh& mesh) {
-        return mesh_objects_.find(mesh.name) != mesh_objects_.end();
-    }
+    bool Renderer::update_frame_uniforms(const FrameUniforms& uniforms) {
+        const StreamAllocation allocation = device_->allocate_stream(sizeof(FrameUniforms), device_->get_uniform_buffer_alignment());
+        if (!allocation.is_valid()) {
+            return false;
+        }
 
-    void Renderer::upload_mesh(const Mesh& mesh) {
-        assert(!has_mesh_objects(mesh) && "Creating the same mesh objects twice");
-
-        GLuint vbo;
-        glGenBuffers(1, &vbo);
-        GLuint vao;
-        glGenVertexArrays(1, &vao);
-        GLuint ebo;
-        glGenBuffers(1, &ebo);
-
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-        glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(leper::Vertex), mesh.vertices.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(leper::Vertex), (void*)offsetof(leper::Vertex, position));
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(leper::Vertex), (void*)offsetof(leper::Vertex, normal));
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glDeleteBuffers(1, &vbo);
-
-        mesh_objects_.insert({mesh.name, MeshGlObjetcs{
-                                             .vao = vao,
-                                             .ebo = ebo}});
+        std::memcpy(allocation.data, &uniforms, sizeof(FrameUniforms));
+        device_->bind_frame_uniforms(allocation);
+        return true;
     }
 
-    void Renderer::draw_mesh(const Mesh& mesh) {
-        if (mesh_objects_.find(mesh.name) != mesh_objects_.end()) {
-            const auto objects = mesh_objects_.at(mesh.name);
-
-            glBindVertexArray(objects.vao);
-            glDrawArrays(GL_TRIANGLES, 0, mesh.vertices.size());
-            glBindVertexArray(0);
-        } else {
-            spdlog::warn("Tried to draw an unuploaded mesh");
+    void Renderer::update_light_clusters(const std::vector<GpuPointLight>& lights, const LightClusters& clusters) {
+        // Bound ranges can't be empty, so there is always at least one light and one index
+        const size_t light_count = std::max<size_t>(std::min(lights.size(), MAX_POINT_LIGHTS), 1);
+        const size_t index_count = std::max<size_t>(clusters.get_index_count(), 1);
+
+        const size_t alignment = device_->get_storage_buffer_alignment();
+        const StreamAllocation light_allocation = device_->allocate_stream(light_count * sizeof(GpuPointLight), alignment);
+        const StreamAllocation cluster_allocation = device_->allocate_stream(LIGHT_CLUSTER_COUNT * sizeof(GpuLightCluster), alignment);
+        const StreamAllocation index_allocation = device_->allocate_stream(index_count * sizeof(uint32_t), alignment);
+        if (!light_allocation.is_valid() || !cluster_allocation.is_valid() || !index_allocation.is_valid()) {
+            return;
         }
-    }
 
-    Shader* Renderer::get_depth_shader() {
-        return depth_shader_.get();
+        std::memset(light_allocation.data, 0, light_allocation.size);
+        std::memcpy(light_allocation.data, lights.data(), std::min(lights.size(), MAX_POINT_LIGHTS) * sizeof(GpuPointLight));
+        std::memcpy(cluster_allocation.data, clusters.get_clusters().data(), LIGHT_CLUSTER_COUNT * sizeof(GpuLightCluster));
+        std::memset(index_allocation.data, 0, index_allocation.size);
+        std::memcpy(index_allocation.data, clusters.get_indices().data(), clusters.get_index_count() * sizeof(uint32_t));
+        device_->bind_light_clusters(light_allocation, cluster_allocation, index_allocation);
     }
 
-    void Renderer::reload_shaders() {
-        for (auto& shader_pair : shaders_) {
-            shader_pair.second.reload();
-        }
+    void Renderer::refresh_static_shadow(uint32_t cascade) {
+        assert(cascade < SHADOW_CASCADE_COUNT && "Shadow cascade out of range");
+        static_shadow_refreshes_ |= 1u << cascade;
     }
 
-    void Renderer::draw_trail(uint16_t width, uint16_t height,const std::vector<glm::vec2>& trailPoints) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, width, height);
-        glDisable(GL_DEPTH_TEST);
-
-        glLineWidth(5.0f);
+    void Renderer::execute(const RenderQueue& queue) {
+        size_t count = std::min(queue.size(), MAX_RENDER_COMMANDS);
 
-        trail_shader_->bind();
-        glBindVertexArray(trail_vao_);
-        glBindBuffer(GL_ARRAY_BUFFER, trail_vbo_);
+        // Instances are laid out in command order so every batch is a contiguous range
+        const StreamAllocation allocation = device_->allocate_stream(count * sizeof(InstanceData), sizeof(InstanceData));
+        if (!allocation.is_valid()) {
+            count = 0;
+        }
 
-        glBufferSubData(GL_ARRAY_BUFFER, 0, trailPoints.size() * sizeof(glm::vec2), trailPoints.data());
-        glDrawArrays(GL_LINE_STRIP, 0, trailPoints.size());
+        InstanceData* instances = static_cast<InstanceData*>(allocation.data);
+        for (size_t i = 0; i < count; i++) {
+            const DrawItem& item = queue.get_item(queue.get_command(i).item);
+            instances[i] = {.model = item.model, .color = glm::vec4(item.color, 1.0f)};
+        }
+        const size_t base_instance = allocation.offset / sizeof(InstanceData);
 
-        glBindVertexArray(0);
+        // At worst one indirect command per queued draw
+        const StreamAllocation indirect = device_->allocate_stream(count * sizeof(DrawElementsIndirectCommand), alignof(DrawElementsIndirectCommand));
+        if (!indirect.is_valid()) {
+            count = 0;
+        }
+        DrawElementsIndirectCommand* commands = static_cast<DrawElementsIndirectCommand*>(indirect.data);
+        size_t command_count = 0;
+
+        device_->bind_meshes();
+        stats_.vao_binds++;
+
+        size_t index = 0;
+
+        for (uint8_t pass_index = 0; pass_index < static_cast<uint8_t>(RenderPass::Count); pass_index++) {
+            const RenderPass pass = static_cast<RenderPass>(pass_index);
+
+            // Cached static shadows keep their content unless refreshed
+            if (is_static_shadow_pass(pass) && !(static_shadow_refreshes_ & (1u << get_shadow_cascade(pass)))) {
+                while (index < count && get_render_pass(queue.get_command(index).key) == pass) {
+                    index++;
+                }
+                continue;
+            }
+
+            // Passes are started even when empty so their targets get cleared
+            device_->begin_pass(pass);
+            // The full queue doesn't tell which passes lost draws, and commands past `count`
+            // were dropped for a full stream
+            bool is_pass_complete = !queue.has_dropped();
+            for (size_t dropped = count; dropped < queue.size() && is_pass_complete; dropped++) {
+                is_pass_complete = get_render_pass(queue.get_command(dropped).key) != pass;
+            }
+
+            while (index < count && get_render_pass(queue.get_command(index).key) == pass) {
+                // Every batch drawn with the same program goes out in one multi draw
+                const ShaderHandle shader = queue.get_item(queue.get_command(index).item).shader;
+                const size_t first_command = command_count;
+
+                while (index < count && get_render_pass(queue.get_command(index).key) == pass &&
+                       queue.get_item(queue.get_command(index).item).shader == shader) {
+                    const size_t first = index;
+                    const uint64_t batch_key = get_batch_key(queue.get_command(first).key);
+                    while (index < count && get_batch_key(queue.get_command(index).key) == batch_key) {
+                        index++;
+                    }
+
+                    const MeshGlObjetcs* objects = meshes_.get(queue.get_item(queue.get_command(first).item).mesh);
+                    if (!objects) {
+                        spdlog::warn("Tried to draw a stale mesh handle");
+                        is_pass_complete = false;
+                        continue;
+                    }
+
+                    const MeshRange& range = objects->range;
+                    const GLuint instance_count = static_cast<GLuint>(index - first);
+                    commands[command_count++] = {
+                        .count = range.index_count,
+                        .instance_count = instance_count,
+                        .first_index = range.first_index,
+                        .base_vertex = static_cast<GLint>(range.first_vertex),
+                        .base_instance = static_cast<GLuint>(base_instance + first),
+                    };
+                    stats_.instances += instance_count;
+                }
+
+                const size_t draw_count = command_count - first_command;
+                const ProgramId* program = shaders_.get(shader);
+                if (!program) {
+                    is_pass_complete = false;
+                }
+                if (draw_count == 0 || !program) {
+                    command_count = first_command;
+                    continue;
+                }
+
+                device_->use_program(*program);
+                stats_.shader_binds++;
+
+                device_->multi_draw_indirect(indirect, first_command, draw_count);
+                stats_.draw_calls++;
+                stats_.batches += draw_count;
+            }
+
+            if (is_static_shadow_pass(pass) && is_pass_complete) {
+                completed_static_shadows_ |= 1u << get_shadow_cascade(pass);
+            }
+        }
     }
 
-    Renderer::~Renderer() {
-        glDeleteRenderbuffers(1, &main_depth_rbo_);
-        glDeleteTextures(1, &main_texture_);
-        glDeleteFramebuffers(1, &main_fbo_);
-
-        glDeleteTextures(1, &shadow_map_);
-        glDeleteFramebuffers(1, &shadow_map_fbo_);
+    void Renderer::reload_shaders() {
+        device_->reload_programs();
+    }
 
-        for (auto& shader_pair : shaders_) {
-            shader_pair.second.cleanup();
+    void Renderer::draw_trail(uint16_t width, uint16_t height, const TrailPoints& trail) {
+        if (trail.size() < 2) {
+            return;
         }
-        depth_shader_->cleanup();
-
-        for (auto& mesh_pair : mesh_objects_) {
-            glDeleteVertexArrays(1, &mesh_pair.second.vao);
-            glDeleteBuffers(1, &mesh_pair.second.ebo);
+        const StreamAllocation allocation = device_->allocate_stream(2 * trail.size() * sizeof(TrailVertex), sizeof(TrailVertex));
+        if (!allocation.is_valid()) {
+            return;
         }
+
+        const uint32_t vertex_count = tessellate_trail_ribbon(trail, width, height, static_cast<TrailVertex*>(allocation.data));
+        device_->draw_screen_ribbon(allocation, vertex_count, width, height);
     }
 
 } // namespace leper
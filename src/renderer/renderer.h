@@ -1,32 +1,61 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <limits>
 #include <memory>
-#include <unordered_map>
 
 #include "leper/leper_common_types.h"
 #include "leper/leper_rendering_types.h"
-#include "shader/shader.h"
+#include "device/render_device.h"
+#include "frame_uniforms.h"
+#include "render_queue.h"
+#include "render_packet.h"
+#include "lighting/light_clusters.h"
+#include "trail/trail_ribbon.h"
 #include "shader/material_id_to_shader_files.h"
+#include "../utils/handle_pool.h"
 
 namespace leper {
 
     class Renderer {
       public:
-        Renderer();
-        ~Renderer();
+        explicit Renderer(std::unique_ptr<RenderDevice> device);
 
-        void start_shadow_frame();
-        void start_main_frame();
+        // Resets the per frame statistics and moves to the next streaming region
+        void begin_frame();
+        // Fences everything streamed during the frame
+        void end_frame();
         void finish_main_frame(uint16_t width, uint16_t height);
-
-        bool has_mesh_objects(const Mesh& mesh);
-        void upload_mesh(const Mesh& mesh);
-        void draw_mesh(const Mesh& mesh);
+        // Whole frame from a built packet: pending uploads and reloads, uniforms, lights, every
+        // pass, present and the trail. Upload results are written back to the packet
+        void submit(RenderPacket& packet);
+
+        // Meshes are suballocated from one shared arena, every upload gets its own handle
+        MeshHandle upload_mesh(const Mesh& mesh);
+        void unload_mesh(MeshHandle mesh);
+        bool is_mesh_uploaded(MeshHandle mesh) const { return meshes_.contains(mesh); }
+        // Small dense id used in render sort keys
+        static uint16_t get_mesh_sort_id(MeshHandle mesh) { return static_cast<uint16_t>(mesh.index); }
+
+        // Single upload of everything shared by the programs during a frame. False when the stream is full
+        bool update_frame_uniforms(const FrameUniforms& uniforms);
+        // Streams the point lights with their cluster lists for the main pass
+        void update_light_clusters(const std::vector<GpuPointLight>& lights, const LightClusters& clusters);
+
+        // Redraws the cached static shadow of a cascade this frame, its pass is skipped otherwise
+        void refresh_static_shadow(uint32_t cascade);
+        // Refreshed cascades whose static shadow got every queued caster, valid after `execute`
+        uint32_t get_completed_static_shadows() const { return completed_static_shadows_; }
+
+        // Runs every pass over the sorted queue. Each run of commands sharing a shader and a mesh
+        // becomes one indirect command, and every run sharing a shader one multi draw
+        void execute(const RenderQueue& queue);
+        const RenderStats& get_frame_stats() const { return stats_; }
 
         template <typename T>
         bool has_material_shader() {
-            return shaders_.find(get_material_id<T>()) != shaders_.end();
+            return material_shaders_[get_material_id<T>()].is_valid();
         }
         template <typename T>
         void create_shader() {
@@ -35,40 +64,34 @@ namespace leper {
             const MaterialId material_id = get_material_id<T>();
 
             const std::pair<std::string, std::string> shader_names = MATERIAL_TO_SHADER_FILES.at(material_id);
-            shaders_.insert({material_id, Shader(shader_names.first, shader_names.second)});
+            material_shaders_[material_id] = shaders_.insert(device_->create_program(shader_names.first, shader_names.second));
         }
+        // Invalid when the material has no shader yet
         template <typename T>
-        Shader* get_material_shader() {
-
-            if (has_material_shader<T>()) {
-                return &shaders_.at(get_material_id<T>());
-            }
-            return nullptr;
+        ShaderHandle get_material_shader() {
+            return material_shaders_[get_material_id<T>()];
         }
-        Shader* get_depth_shader();
+        ShaderHandle get_depth_shader() const { return depth_shader_; }
         void reload_shaders();
 
-        void draw_trail(uint16_t width, uint16_t height, const std::vector<glm::vec2>& trailPoints);
-
-      private:
-        void init_main_frame();
-        void init_shadow_map();
-        void init_trail();
+        // Tessellates the trail straight into streamed memory and draws it over the screen
+        void draw_trail(uint16_t width, uint16_t height, const TrailPoints& trail);
 
-        std::unordered_map<std::string, MeshGlObjetcs> mesh_objects_;
-        std::unordered_map<MaterialId, Shader> shaders_;
+        RenderDevice& get_device() { return *device_; }
 
-        GLuint main_fbo_ = 0;
-        GLuint main_texture_ = 0;
-        GLuint main_depth_rbo_ = 0;
-
-        std::unique_ptr<Shader> depth_shader_;
-        GLuint shadow_map_fbo_ = 0;
-        GLuint shadow_map_ = 0;
-
-        std::unique_ptr<Shader> trail_shader_;
-        GLuint trail_vao_ = 0;
-        GLuint trail_vbo_ = 0;
+      private:
+        std::unique_ptr<RenderDevice> device_;
+
+        HandlePool<MeshGlObjetcs, MeshTag> meshes_;
+        HandlePool<ProgramId, ShaderTag> shaders_;
+        // Indexed by MaterialId
+        std::array<ShaderHandle, std::numeric_limits<MaterialId>::max() + 1> material_shaders_ = {};
+        ShaderHandle depth_shader_ = {};
+
+        RenderStats stats_ = {};
+        // One bit per cascade, reset every frame
+        uint32_t static_shadow_refreshes_ = 0;
+        uint32_t completed_static_shadows_ = 0;
     };
 
 } // namespace leper
@@ -0,0 +1,66 @@
+#include "resolution_scaler.h"
+
+#include <algorithm>
+
+#include "leper/leper_rendering_constants.h"
+
+namespace leper {
+
+    // Weight of a new frame time in the average
+    constexpr float_t FRAME_TIME_SMOOTHING = 0.1f;
+    // Frames measured after a change before the next one
+    constexpr uint32_t SETTLE_FRAME_COUNT = 30;
+    // Aims below the budget, so scaling up does not push frames right back over it
+    constexpr float_t BUDGET_HEADROOM = 0.9f;
+    // Relative scale changes below this are ignored
+    constexpr float_t SCALE_HYSTERESIS = 0.05f;
+    // Largest relative change at once
+    constexpr float_t MAX_SCALE_STEP = 0.25f;
+
+    ResolutionScaler::ResolutionScaler(float_t budget_milliseconds, float_t scale)
+        : budget_milliseconds_(budget_milliseconds) {
+        set_scale(scale);
+    }
+
+    bool ResolutionScaler::add_frame_time(float_t milliseconds) {
+        average_milliseconds_ = sample_count_ == 0
+                                    ? milliseconds
+                                    : average_milliseconds_ + (milliseconds - average_milliseconds_) * FRAME_TIME_SMOOTHING;
+        sample_count_++;
+        if (sample_count_ < SETTLE_FRAME_COUNT || average_milliseconds_ <= 0.0f) {
+            return false;
+        }
+
+        const float_t step = std::sqrt(budget_milliseconds_ * BUDGET_HEADROOM / average_milliseconds_);
+        const float_t scale = std::clamp(scale_ * std::clamp(step, 1.0f - MAX_SCALE_STEP, 1.0f + MAX_SCALE_STEP),
+                                         MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+        if (std::abs(scale - scale_) < scale_ * SCALE_HYSTERESIS) {
+            return false;
+        }
+
+        const uint16_t width = get_width();
+        set_scale(scale);
+        return get_width() != width;
+    }
+
+    void ResolutionScaler::set_scale(float_t scale) {
+        scale_ = std::clamp(scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+        reset_measurements();
+    }
+
+    void ResolutionScaler::reset_measurements() {
+        average_milliseconds_ = 0.0f;
+        sample_count_ = 0;
+    }
+
+    uint16_t ResolutionScaler::get_width() const {
+        const float_t alignments = std::round(MAIN_FRAME_WIDTH * scale_ / MAIN_FRAME_WIDTH_ALIGNMENT);
+        return static_cast<uint16_t>(std::max(alignments, 1.0f) * MAIN_FRAME_WIDTH_ALIGNMENT);
+    }
+
+    uint16_t ResolutionScaler::get_height() const {
+        const float_t height = std::round(static_cast<float_t>(get_width()) * MAIN_FRAME_HEIGHT / MAIN_FRAME_WIDTH);
+        return static_cast<uint16_t>(std::max(height, 1.0f));
+    }
+
+} // namespace leper
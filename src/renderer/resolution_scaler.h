@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace leper {
+
+    // Picks the internal resolution that keeps the measured frame time under a budget.
+    // Cost is taken as proportional to the pixel count, so the render scale moves by the
+    // square root of the budget over the smoothed frame time. Each change waits for the
+    // average to settle and small errors are ignored, so targets are not reallocated every frame
+    class ResolutionScaler {
+      public:
+        explicit ResolutionScaler(float_t budget_milliseconds, float_t scale = 1.0f);
+
+        // Returns true when the main target size changed
+        bool add_frame_time(float_t milliseconds);
+        // Clamped to the render scale range, restarts the measurements
+        void set_scale(float_t scale);
+        // Forgets the frame times so far, for frames measured under other conditions
+        void reset_measurements();
+
+        float_t get_scale() const { return scale_; }
+        // Main target size at the current scale, with the aspect of the default main frame
+        uint16_t get_width() const;
+        uint16_t get_height() const;
+
+      private:
+        float_t budget_milliseconds_;
+        float_t scale_ = 1.0f;
+        // Moving average of the frames since the last change
+        float_t average_milliseconds_ = 0.0f;
+        uint32_t sample_count_ = 0;
+    };
+
+} // namespace leper
@@ -0,0 +1,153 @@
+#include "program_binary_cache.h"
+
+#include <fstream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace leper {
+
+    // "LPB" and a format version, bumped whenever the entry layout changes
+    constexpr uint32_t PROGRAM_BINARY_MAGIC = 0x0142504cu;
+
+    struct ProgramBinaryHeader {
+        uint32_t magic;
+        GLenum format;
+        // Sources and driver, a file renamed by hand or a hash collision on the name still misses
+        uint64_t sources_hash;
+        uint64_t driver_hash;
+        uint64_t size;
+    };
+
+    // FNV-1a, chained through `hash`
+    static uint64_t hash_bytes(std::string_view bytes, uint64_t hash = 0xcbf29ce484222325ull) {
+        for (const char byte : bytes) {
+            hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static std::string_view get_gl_string(GLenum name) {
+        const auto* string = reinterpret_cast<const char*>(glGetString(name));
+        return string ? string : "";
+    }
+
+    ProgramBinaryCache::ProgramBinaryCache(std::filesystem::path directory) : directory_(std::move(directory)) {
+        GLint format_count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        if (format_count == 0) {
+            spdlog::info("Driver has no program binary formats, programs are always compiled");
+            return;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(directory_, error);
+        if (error) {
+            spdlog::warn("Program binary cache disabled, could not create {}: {}", directory_.string(), error.message());
+            return;
+        }
+
+        // The separators keep "ab" + "c" apart from "a" + "bc"
+        driver_hash_ = hash_bytes(get_gl_string(GL_VENDOR));
+        driver_hash_ = hash_bytes("\n", driver_hash_);
+        driver_hash_ = hash_bytes(get_gl_string(GL_RENDERER), driver_hash_);
+        driver_hash_ = hash_bytes("\n", driver_hash_);
+        driver_hash_ = hash_bytes(get_gl_string(GL_VERSION), driver_hash_);
+        enabled_ = true;
+    }
+
+    uint64_t ProgramBinaryCache::hash_sources(const std::string& vertex_code, const std::string& fragment_code) {
+        const uint64_t hash = hash_bytes(vertex_code);
+        return hash_bytes(fragment_code, hash_bytes(std::string_view("\0", 1), hash));
+    }
+
+    std::filesystem::path ProgramBinaryCache::get_entry_path(uint64_t sources_hash) const {
+        return directory_ / fmt::format("{:016x}.bin", sources_hash ^ driver_hash_);
+    }
+
+    GLuint ProgramBinaryCache::load(uint64_t sources_hash) const {
+        if (!enabled_) {
+            return 0;
+        }
+
+        std::ifstream file(get_entry_path(sources_hash), std::ios::binary | std::ios::ate);
+        if (!file) {
+            return 0;
+        }
+        const std::streamoff file_size = file.tellg();
+        file.seekg(0);
+
+        ProgramBinaryHeader header = {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != PROGRAM_BINARY_MAGIC || header.sources_hash != sources_hash || header.driver_hash != driver_hash_) {
+            return 0;
+        }
+        // Entries are written whole, so any other size is a truncated or corrupt file
+        if (header.size != static_cast<uint64_t>(file_size) - sizeof(header)) {
+            spdlog::warn("Ignoring a program binary cache entry whose size doesn't match its file");
+            return 0;
+        }
+
+        std::vector<char> binary(header.size);
+        file.read(binary.data(), static_cast<std::streamsize>(binary.size()));
+        if (!file) {
+            return 0;
+        }
+
+        const GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+        // Drivers may refuse their own binaries, e.g. after a state change, which is not an error
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void ProgramBinaryCache::store(uint64_t sources_hash, GLuint program) const {
+        if (!enabled_) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+
+        std::vector<char> binary(static_cast<size_t>(length));
+        ProgramBinaryHeader header = {
+            .magic = PROGRAM_BINARY_MAGIC,
+            .sources_hash = sources_hash,
+            .driver_hash = driver_hash_,
+        };
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.size = static_cast<uint64_t>(written);
+
+        const std::filesystem::path path = get_entry_path(sources_hash);
+        std::filesystem::path temporary_path = path;
+        temporary_path += ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), written);
+            if (!file) {
+                spdlog::warn("Could not write program binary {}", temporary_path.string());
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, path, error);
+        if (error) {
+            spdlog::warn("Could not move program binary to {}: {}", path.string(), error.message());
+            std::filesystem::remove(temporary_path, error);
+        }
+    }
+
+} // namespace leper
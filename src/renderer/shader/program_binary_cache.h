@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <glad/glad.h>
+
+namespace leper {
+
+    // Linked programs saved with glGetProgramBinary, one file per program. Entries are keyed by the
+    // preprocessed sources and the driver, so edited shaders and driver updates just miss.
+    // Needs a current context when constructed
+    class ProgramBinaryCache {
+      public:
+        explicit ProgramBinaryCache(std::filesystem::path directory);
+
+        // Hash of the preprocessed sources a program is cached under
+        static uint64_t hash_sources(const std::string& vertex_code, const std::string& fragment_code);
+
+        // Linked program, or 0 when the entry is missing or the driver rejects it
+        GLuint load(uint64_t sources_hash) const;
+        // Program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+        // Written to a temporary file first, so readers never see a partial entry
+        void store(uint64_t sources_hash, GLuint program) const;
+
+        bool is_enabled() const { return enabled_; }
+
+      private:
+        std::filesystem::path get_entry_path(uint64_t sources_hash) const;
+
+        std::filesystem::path directory_;
+        // Vendor, renderer and version strings
+        uint64_t driver_hash_ = 0;
+        bool enabled_ = false;
+    };
+
+} // namespace leper
@@ -1,22 +1,25 @@
 #include "shader.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
-#include <glm/gtc/type_ptr.hpp>
+#include <sstream>
+#include <string_view>
+#include <utility>
 #include <spdlog/spdlog.h>
 
 namespace leper {
 
-    Shader::Shader(const std::string& vertex_shader_name, const std::string& fragment_shader_name)
-        : vertex_shader_name_(vertex_shader_name), fragment_shader_name_(fragment_shader_name) {
+    constexpr uint8_t MAX_SHADER_INCLUDE_DEPTH = 8;
 
-        const std::string vertex_code = Shader::read_shader_file(vertex_shader_name);
-        const std::string fragment_code = Shader::read_shader_file(fragment_shader_name);
+    Shader::Shader(const std::string& vertex_shader_name, const std::string& fragment_shader_name,
+                   const ProgramBinaryCache* binary_cache)
+        : vertex_shader_name_(vertex_shader_name), fragment_shader_name_(fragment_shader_name), binary_cache_(binary_cache) {
 
-        program_ = compile(vertex_code.c_str(), fragment_code.c_str());
+        reload();
     }
 
-    void Shader::check_compilation_errors(GLuint shader, CompilationStepCheck step) {
+    bool Shader::check_compilation_errors(GLuint shader, CompilationStepCheck step) {
         int success;
         char info_log[1024];
 
@@ -35,9 +38,15 @@ namespace leper {
                               to_string(step), info_log);
             }
         }
+        return success;
     }
 
-    std::string Shader::read_shader_file(const std::string& file_name) {
+    std::string Shader::read_shader_file(const std::string& file_name, std::vector<std::string>& dependencies, uint8_t include_depth) {
+        // Missing files are dependencies too, creating them fixes the build
+        if (std::find(dependencies.begin(), dependencies.end(), file_name) == dependencies.end()) {
+            dependencies.push_back(file_name);
+        }
+
         std::filesystem::path shader_file_path = std::filesystem::path(SHADER_DIR) / file_name;
         std::ifstream file(shader_file_path);
 
@@ -46,87 +55,137 @@ namespace leper {
         }
 
         std::stringstream shaderStream;
-        shaderStream << file.rdbuf();
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+
+            const std::string_view directive = "#include \"";
+            if (line.rfind(directive, 0) != 0) {
+                shaderStream << line << '\n';
+                continue;
+            }
+
+            if (include_depth >= MAX_SHADER_INCLUDE_DEPTH) {
+                spdlog::error("Shader includes nested too deep in {}", file_name);
+                continue;
+            }
+
+            const size_t end = line.find('"', directive.size());
+            const std::string included = line.substr(directive.size(), end - directive.size());
+            shaderStream << read_shader_file(included, dependencies, include_depth + 1);
+            // Keeps compiler errors pointing at the lines of this file
+            shaderStream << "#line " << line_number + 1 << '\n';
+        }
+
         file.close();
         return shaderStream.str();
     }
 
-    GLuint Shader::compile(const char* vertex_code, const char* fragment_code) {
-
-        GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex_shader, 1, &vertex_code, nullptr);
-        glCompileShader(vertex_shader);
-        Shader::check_compilation_errors(vertex_shader, CompilationStepCheck::Vertex);
+    void Shader::build(const std::string& vertex_code, const std::string& fragment_code) {
+        discard_pending();
+        build_start_ = std::chrono::steady_clock::now();
 
-        GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment_shader, 1, &fragment_code, nullptr);
-        glCompileShader(fragment_shader);
-        Shader::check_compilation_errors(fragment_shader, CompilationStepCheck::Fragment);
+        const uint64_t sources_hash = ProgramBinaryCache::hash_sources(vertex_code, fragment_code);
+        if (binary_cache_) {
+            if (const GLuint program = binary_cache_->load(sources_hash)) {
+                replace_program(program, true);
+                return;
+            }
+        }
+        submit_compile(vertex_code.c_str(), fragment_code.c_str(), sources_hash);
+    }
 
-        GLuint shader_program;
-        shader_program = glCreateProgram();
-        glAttachShader(shader_program, vertex_shader);
-        glAttachShader(shader_program, fragment_shader);
-        glLinkProgram(shader_program);
-        Shader::check_compilation_errors(fragment_shader, CompilationStepCheck::Program);
+    void Shader::submit_compile(const char* vertex_code, const char* fragment_code, uint64_t sources_hash) {
+        // No status is read here, that would wait for each step before the next one is submitted
+        pending_.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending_.vertex_shader, 1, &vertex_code, nullptr);
+        glCompileShader(pending_.vertex_shader);
+
+        pending_.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending_.fragment_shader, 1, &fragment_code, nullptr);
+        glCompileShader(pending_.fragment_shader);
+
+        pending_.program = glCreateProgram();
+        glAttachShader(pending_.program, pending_.vertex_shader);
+        glAttachShader(pending_.program, pending_.fragment_shader);
+        if (binary_cache_) {
+            glProgramParameteri(pending_.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(pending_.program);
+        pending_.sources_hash = sources_hash;
+    }
 
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
+    bool Shader::update(bool can_poll) {
+        if (!is_building()) {
+            return false;
+        }
 
-        return shader_program;
-    }
+        if (can_poll) {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(pending_.program, GL_COMPLETION_STATUS_KHR, &completed);
+            if (!completed) {
+                return false;
+            }
+        }
 
-    void Shader::bind() {
-        glUseProgram(program_);
-    }
+        if (!finish_compile()) {
+            spdlog::error("Building {} + {} failed", vertex_shader_name_, fragment_shader_name_);
+            discard_pending();
+            return false;
+        }
 
-    void Shader::set_uniform_1i(const std::string& name, int i) {
-        int loc = glGetUniformLocation(program_, name.c_str());
-        if (loc == -1) {
-            spdlog::error("Uniform location not found: {}", name);
+        const GLuint program = std::exchange(pending_.program, 0);
+        if (binary_cache_) {
+            binary_cache_->store(pending_.sources_hash, program);
         }
-        glUniform1i(loc, i);
+        discard_pending();
+        replace_program(program, false);
+        return true;
     }
 
-    void Shader::set_uniform_1f(const std::string& name, float f) {
-        int loc = glGetUniformLocation(program_, name.c_str());
-        if (loc == -1) {
-            spdlog::error("Uniform location not found: {}", name);
+    bool Shader::finish_compile() {
+        // Every step is checked so each failing one is logged
+        const bool vertex_compiled = Shader::check_compilation_errors(pending_.vertex_shader, CompilationStepCheck::Vertex);
+        const bool fragment_compiled = Shader::check_compilation_errors(pending_.fragment_shader, CompilationStepCheck::Fragment);
+        if (!vertex_compiled || !fragment_compiled) {
+            return false;
         }
-        glUniform1f(loc, f);
+        return Shader::check_compilation_errors(pending_.program, CompilationStepCheck::Program);
     }
 
-    void Shader::set_uniform_vec3f(const std::string& name, glm::vec3 v) {
-        int loc = glGetUniformLocation(program_, name.c_str());
-        if (loc == -1) {
-            spdlog::error("Uniform location not found: {}", name);
-        }
-        glUniform3fv(loc, 1, glm::value_ptr(v));
+    void Shader::discard_pending() {
+        glDeleteShader(pending_.vertex_shader);
+        glDeleteShader(pending_.fragment_shader);
+        glDeleteProgram(pending_.program);
+        pending_ = {};
     }
 
-    void Shader::set_uniform_mat4f(const std::string& name, glm::mat4 m) {
-        int loc = glGetUniformLocation(program_, name.c_str());
-        if (loc == -1) {
-            spdlog::error("Uniform location not found: {}", name);
-        }
-        glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(m));
+    void Shader::replace_program(GLuint program, bool from_binary_cache) {
+        glDeleteProgram(program_);
+        program_ = program;
+        from_binary_cache_ = from_binary_cache;
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - build_start_;
+        spdlog::info("Program {} + {} ready after {:.2f} ms, {}", vertex_shader_name_, fragment_shader_name_, elapsed.count(),
+                     from_binary_cache ? "from the binary cache" : "compiled");
     }
 
     void Shader::reload() {
-        const std::string vertex_code = Shader::read_shader_file(vertex_shader_name_);
-        const std::string fragment_code = Shader::read_shader_file(fragment_shader_name_);
-
-        program_ = compile(vertex_code.c_str(), fragment_code.c_str());
+        dependencies_.clear();
+        const std::string vertex_code = Shader::read_shader_file(vertex_shader_name_, dependencies_);
+        const std::string fragment_code = Shader::read_shader_file(fragment_shader_name_, dependencies_);
+        build(vertex_code, fragment_code);
+    }
 
-        GLuint new_program = compile(vertex_code.c_str(), fragment_code.c_str());
-        if (new_program != 0) {
-            glDeleteProgram(program_);
-            program_ = new_program;
-        }
+    bool Shader::depends_on(const std::string& file_name) const {
+        return std::find(dependencies_.begin(), dependencies_.end(), file_name) != dependencies_.end();
     }
 
     void Shader::cleanup() {
+        discard_pending();
         glDeleteProgram(program_);
+        program_ = 0;
     }
 
 } // namespace leper
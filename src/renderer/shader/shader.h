@@ -1,9 +1,17 @@
 #pragma once
 
+#include <chrono>
 #include <string>
-#include <glm/glm.hpp>
+#include <vector>
 #include <glad/glad.h>
 
+#include "program_binary_cache.h"
+
+// KHR_parallel_shader_compile, which the generated loader does not include
+#ifndef GL_COMPLETION_STATUS_KHR
+#    define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace leper {
 
     enum class CompilationStepCheck {
@@ -25,28 +33,63 @@ namespace leper {
         }
     }
 
+    // Program built in the background: compiling and linking are only submitted, and their status is
+    // read by update() once the driver is done. Linked programs are looked up in and added to the
+    // binary cache when there is one, a cache hit is ready right away
     class Shader {
       public:
-        Shader(const std::string& vertex_shader_name, const std::string& fragment_shader_name);
+        Shader(const std::string& vertex_shader_name, const std::string& fragment_shader_name,
+               const ProgramBinaryCache* binary_cache = nullptr);
 
-        void bind();
+        // 0 until the first build succeeds
+        GLuint get_program() const { return program_; }
+        bool is_ready() const { return program_ != 0; }
+        bool is_building() const { return pending_.program != 0; }
+        // Whether the current program came from the binary cache instead of the compiler
+        bool is_from_binary_cache() const { return from_binary_cache_; }
 
-        void set_uniform_1i(const std::string& name, int i);
-        void set_uniform_1f(const std::string& name, float f);
-        void set_uniform_vec3f(const std::string& name, glm::vec3 v);
-        void set_uniform_mat4f(const std::string& name, glm::mat4 m);
+        // Finishes the pending build. With `can_poll` the driver is asked whether it is done and a build
+        // still compiling is left alone, otherwise reading the status waits for it.
+        // Returns true when a new program replaced the current one
+        bool update(bool can_poll);
 
+        // Starts a new build from the files, the current program stays in use until it succeeds
         void reload();
-        void cleanup(); 
+        // Whether the file, relative to the shader directory, is one of the sources or their includes
+        bool depends_on(const std::string& file_name) const;
+        void cleanup();
 
       private:
-        static void check_compilation_errors(GLuint shader, CompilationStepCheck step);
-        static std::string read_shader_file(const std::string& file_name);
-        GLuint compile(const char* vertCode, const char* fragCode);
+        // Objects of a submitted build whose status was not read yet
+        struct PendingBuild {
+            GLuint vertex_shader = 0;
+            GLuint fragment_shader = 0;
+            GLuint program = 0;
+            uint64_t sources_hash = 0;
+        };
+
+        static bool check_compilation_errors(GLuint shader, CompilationStepCheck step);
+        // Expands `#include "file"` lines, paths are relative to the shader directory.
+        // Every file read is added to `dependencies`
+        static std::string read_shader_file(const std::string& file_name, std::vector<std::string>& dependencies,
+                                            uint8_t include_depth = 0);
+        // Binary cache first, submitting a compile on a miss
+        void build(const std::string& vertex_code, const std::string& fragment_code);
+        void submit_compile(const char* vertex_code, const char* fragment_code, uint64_t sources_hash);
+        // Checks every step of the pending build, true when it linked
+        bool finish_compile();
+        void discard_pending();
+        void replace_program(GLuint program, bool from_binary_cache);
 
         GLuint program_ = 0;
+        PendingBuild pending_ = {};
+        std::chrono::steady_clock::time_point build_start_ = {};
         std::string vertex_shader_name_;
         std::string fragment_shader_name_;
+        // Files of the last build, sources and includes
+        std::vector<std::string> dependencies_;
+        const ProgramBinaryCache* binary_cache_ = nullptr;
+        bool from_binary_cache_ = false;
     };
 
 } // namespace leper
@@ -0,0 +1,152 @@
+#include "shadow_fitting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "leper/leper_rendering_constants.h"
+
+namespace leper {
+
+    // View distance the cascades start at, at least
+    constexpr float_t MIN_CASCADE_NEAR = 0.05f;
+
+    glm::mat4 get_directional_light_view(const glm::vec3& light_direction) {
+        const glm::vec3 dir = glm::normalize(light_direction);
+        // lookAt degenerates when looking straight up or down
+        const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        // The view is anchored to the world origin and not to the receivers so
+        // that texel snapping happens on a grid that never moves
+        return glm::lookAt(dir, glm::vec3(0.0f, 0.0f, 0.0f), up);
+    }
+
+    static float_t snap_down(float_t depth) {
+        return std::floor(depth / SHADOW_EXTENT_QUANTUM) * SHADOW_EXTENT_QUANTUM;
+    }
+
+    static float_t snap_up(float_t depth) {
+        return std::ceil(depth / SHADOW_EXTENT_QUANTUM) * SHADOW_EXTENT_QUANTUM;
+    }
+
+    static void update_light_matrix(DirectionalShadowFit& fit) {
+        const AABB& bounds = fit.light_space_bounds;
+        // View space looks down -Z: the near plane is the highest Z
+        fit.projection = glm::ortho(bounds.min.x, bounds.max.x,
+                                    bounds.min.y, bounds.max.y,
+                                    -bounds.max.z, -bounds.min.z);
+        fit.light_matrix = fit.projection * fit.view;
+    }
+
+    std::array<float_t, SHADOW_CASCADE_COUNT> compute_cascade_splits(float_t near, float_t far, float_t lambda) {
+        std::array<float_t, SHADOW_CASCADE_COUNT> splits;
+        for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            const float_t t = static_cast<float_t>(i + 1) / SHADOW_CASCADE_COUNT;
+            const float_t logarithmic = near * std::pow(far / near, t);
+            const float_t uniform = near + (far - near) * t;
+            splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+        }
+        splits.back() = far;
+        return splits;
+    }
+
+    ShadowCascades fit_shadow_cascades(const glm::vec3& light_direction,
+                                       const glm::mat4& camera_view,
+                                       const glm::mat4& camera_projection,
+                                       float_t near, float_t far,
+                                       uint16_t shadow_map_size) {
+        ShadowCascades cascades = {};
+
+        // The logarithmic part needs a positive near distance
+        near = std::max(near, MIN_CASCADE_NEAR);
+        far = std::max(far, near + MIN_CASCADE_NEAR);
+        cascades.split_distances = compute_cascade_splits(near, far, SHADOW_CASCADE_SPLIT_LAMBDA);
+
+        const glm::mat4 light_view = get_directional_light_view(light_direction);
+        const glm::mat4 inverse_view_projection = glm::inverse(camera_projection * camera_view);
+        auto get_ndc_depth = [&](float_t distance) {
+            const glm::vec4 clip = camera_projection * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+            return clip.z / clip.w;
+        };
+
+        float_t slice_near = near;
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+            const float_t slice_far = cascades.split_distances[cascade];
+            const std::array<float_t, 2> ndc_depths = {get_ndc_depth(slice_near), get_ndc_depth(slice_far)};
+
+            std::array<glm::vec3, 8> corners;
+            glm::vec3 center = glm::vec3(0.0f);
+            for (size_t i = 0; i < corners.size(); i++) {
+                const glm::vec4 ndc = glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, ndc_depths[i >> 2], 1.0f);
+                const glm::vec4 world = inverse_view_projection * ndc;
+                corners[i] = glm::vec3(world) / world.w;
+                center += corners[i] / static_cast<float_t>(corners.size());
+            }
+
+            float_t radius = 0.0f;
+            for (const auto& corner : corners) {
+                radius = std::max(radius, glm::length(corner - center));
+            }
+
+            // Quantize the footprint so the texel size only changes in steps
+            const float_t extent = std::max(std::ceil(2.0f * radius / SHADOW_EXTENT_QUANTUM), 1.0f) * SHADOW_EXTENT_QUANTUM;
+            // The rendered width keeps one texel of margin on each side for the snapping, so the
+            // snapping grid has to use the texel size of that width and not of `extent`
+            const float_t texel_size = extent / static_cast<float_t>(shadow_map_size - 2);
+
+            const glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.0f));
+            const glm::vec2 snapped_center = glm::floor(glm::vec2(light_center) / texel_size) * texel_size;
+
+            DirectionalShadowFit& fit = cascades.fits[cascade];
+            fit.view = light_view;
+            // The depth range is snapped too, so the cached static shadow stays valid
+            // until the volume moves by a whole step
+            const float_t half_extent = 0.5f * static_cast<float_t>(shadow_map_size) * texel_size;
+            fit.light_space_bounds = {
+                .min = glm::vec3(snapped_center - glm::vec2(half_extent), snap_down(light_center.z - radius - SHADOW_DEPTH_MARGIN)),
+                .max = glm::vec3(snapped_center + glm::vec2(half_extent), snap_up(light_center.z + radius + SHADOW_DEPTH_MARGIN)),
+            };
+            update_light_matrix(fit);
+
+            slice_near = slice_far;
+        }
+
+        return cascades;
+    }
+
+    Frustum get_shadow_caster_frustum(const DirectionalShadowFit& fit) {
+        Frustum frustum = extract_frustum(fit.light_matrix);
+        // Near plane that never rejects anything
+        frustum.planes[4] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return frustum;
+    }
+
+    bool is_shadow_caster_relevant(const DirectionalShadowFit& fit, const AABB& caster_bounds) {
+        if (!is_valid(fit.light_space_bounds)) {
+            return false;
+        }
+
+        const AABB light_space = transform_aabb(caster_bounds, fit.view);
+        const AABB& volume = fit.light_space_bounds;
+
+        // Anything between the light and the receivers may cast onto them, so
+        // the volume is unbounded towards the light
+        return light_space.min.x <= volume.max.x && light_space.max.x >= volume.min.x &&
+               light_space.min.y <= volume.max.y && light_space.max.y >= volume.min.y &&
+               light_space.max.z >= volume.min.z;
+    }
+
+    void include_shadow_casters(DirectionalShadowFit& fit, const std::vector<AABB>& caster_bounds, float_t margin) {
+        if (!is_valid(fit.light_space_bounds)) {
+            return;
+        }
+
+        for (const auto& bounds : caster_bounds) {
+            const AABB light_space = transform_aabb(bounds, fit.view);
+            fit.light_space_bounds.max.z = std::max(fit.light_space_bounds.max.z, snap_up(light_space.max.z + SHADOW_DEPTH_MARGIN));
+        }
+        fit.light_space_bounds.max.z = snap_up(fit.light_space_bounds.max.z + margin);
+        update_light_matrix(fit);
+    }
+
+} // namespace leper
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_rendering_constants.h"
+#include "../../math/bounds.h"
+
+namespace leper {
+
+    struct DirectionalShadowFit {
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        glm::mat4 light_matrix = glm::mat4(1.0f);
+
+        // Light view space box covered by the projection. Casters are culled
+        // against its XY footprint and its far side
+        AABB light_space_bounds = {};
+    };
+
+    struct ShadowCascades {
+        std::array<DirectionalShadowFit, SHADOW_CASCADE_COUNT> fits = {};
+        // View space distance where each cascade ends
+        std::array<float_t, SHADOW_CASCADE_COUNT> split_distances = {};
+    };
+
+    glm::mat4 get_directional_light_view(const glm::vec3& light_direction);
+
+    // Practical split scheme: `lambda` blends logarithmic and uniform splits of [near, far].
+    // Returns where each cascade ends, the last one at `far`
+    std::array<float_t, SHADOW_CASCADE_COUNT> compute_cascade_splits(float_t near, float_t far, float_t lambda);
+
+    // Fits one orthographic light volume per slice of the camera frustum between the `near`
+    // and `far` view distances. Slices are enclosed in bounding spheres so the footprint keeps
+    // its size when the camera turns, and the centers are snapped to whole shadow map texels
+    // so the cascades don't shimmer when the camera moves
+    ShadowCascades fit_shadow_cascades(const glm::vec3& light_direction,
+                                       const glm::mat4& camera_view,
+                                       const glm::mat4& camera_projection,
+                                       float_t near, float_t far,
+                                       uint16_t shadow_map_size);
+
+    // World space volume where casters can be, open towards the light. Used for coarse
+    // culling before `is_shadow_caster_relevant`
+    Frustum get_shadow_caster_frustum(const DirectionalShadowFit& fit);
+
+    bool is_shadow_caster_relevant(const DirectionalShadowFit& fit, const AABB& caster_bounds);
+
+    // Pulls the near plane towards the light so every given caster is inside the volume, then
+    // `margin` further for the casters that were left out
+    void include_shadow_casters(DirectionalShadowFit& fit, const std::vector<AABB>& caster_bounds, float_t margin);
+
+} // namespace leper
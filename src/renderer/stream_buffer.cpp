@@ -0,0 +1,93 @@
+#include "stream_buffer.h"
+
+#include <cassert>
+#include <spdlog/spdlog.h>
+
+namespace leper {
+
+    // 1ms, waits are retried until the fence signals
+    constexpr GLuint64 FENCE_WAIT_TIMEOUT_NS = 1000000;
+
+    StreamBuffer::StreamBuffer(size_t frame_size, size_t frame_count)
+        : frame_size_(frame_size), frame_count_(frame_count) {
+        assert(frame_count_ > 0 && frame_count_ <= MAX_STREAM_FRAMES && "Unsupported number of frames in flight");
+
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr total_size = static_cast<GLsizeiptr>(frame_size_ * frame_count_);
+
+        glCreateBuffers(1, &buffer_);
+        glNamedBufferStorage(buffer_, total_size, nullptr, flags);
+        mapped_ = static_cast<uint8_t*>(glMapNamedBufferRange(buffer_, 0, total_size, flags));
+
+        if (!mapped_) {
+            spdlog::error("Failed to map the stream buffer");
+        }
+
+        // Starts on the last region so the first begin_frame lands on the first one
+        frame_index_ = frame_count_ - 1;
+    }
+
+    StreamBuffer::~StreamBuffer() {
+        for (GLsync& fence : fences_) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+        if (mapped_) {
+            glUnmapNamedBuffer(buffer_);
+        }
+        glDeleteBuffers(1, &buffer_);
+    }
+
+    void StreamBuffer::begin_frame() {
+        frame_index_ = (frame_index_ + 1) % frame_count_;
+        frame_offset_ = 0;
+
+        GLsync& fence = fences_[frame_index_];
+        if (!fence) {
+            return;
+        }
+
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT_NS);
+        }
+        if (result == GL_WAIT_FAILED) {
+            spdlog::error("Waiting on a stream buffer fence failed");
+        }
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    void StreamBuffer::end_frame() {
+        GLsync& fence = fences_[frame_index_];
+        if (fence) {
+            glDeleteSync(fence);
+        }
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    StreamAllocation StreamBuffer::allocate(size_t size, size_t alignment) {
+        assert(alignment > 0 && "Alignment must be positive");
+
+        const size_t region_start = frame_index_ * frame_size_;
+        // Aligned from the start of the buffer since offsets are used as GL offsets and element indices
+        const size_t absolute = region_start + frame_offset_;
+        const size_t aligned = (absolute + alignment - 1) / alignment * alignment;
+
+        if (!mapped_ || aligned + size > region_start + frame_size_) {
+            spdlog::warn("Stream buffer is full, dropping an allocation of {} bytes", size);
+            return {};
+        }
+
+        frame_offset_ = aligned + size - region_start;
+
+        return {
+            .data = mapped_ + aligned,
+            .offset = static_cast<GLintptr>(aligned),
+            .size = static_cast<GLsizeiptr>(size),
+        };
+    }
+
+} // namespace leper
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+#include "leper/leper_rendering_types.h"
+
+namespace leper {
+
+    constexpr size_t MAX_STREAM_FRAMES = 3;
+
+    // Persistently mapped buffer split in one region per frame in flight
+    // A region is only written again once the fence of its previous frame signaled
+    class StreamBuffer {
+      public:
+        StreamBuffer(size_t frame_size, size_t frame_count = MAX_STREAM_FRAMES);
+        ~StreamBuffer();
+
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+        // Moves to the next region, waiting on the GPU if it is still reading it
+        void begin_frame();
+        // Fences the commands that read the current region
+        void end_frame();
+
+        // Alignment does not have to be a power of two. Returns an invalid allocation when the region is full
+        StreamAllocation allocate(size_t size, size_t alignment);
+
+        GLuint get_buffer() const { return buffer_; }
+        size_t get_frame_size() const { return frame_size_; }
+
+      private:
+        GLuint buffer_ = 0;
+        uint8_t* mapped_ = nullptr;
+
+        size_t frame_size_;
+        size_t frame_count_;
+        size_t frame_index_ = 0;
+        size_t frame_offset_ = 0;
+        std::array<GLsync, MAX_STREAM_FRAMES> fences_ = {};
+    };
+
+} // namespace leper
@@ -0,0 +1,122 @@
+#include "trail_ribbon.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
+namespace leper {
+
+    // Shortest segment that still has a direction
+    constexpr float_t MIN_SEGMENT_LENGTH = 1e-4f;
+    // Miters of sharp turns are capped at this many half widths
+    constexpr float_t MAX_MITER_SCALE = 4.0f;
+
+    static glm::vec2 get_direction(const glm::vec2& segment) {
+        return segment / std::max(glm::length(segment), MIN_SEGMENT_LENGTH);
+    }
+
+    static void write_pair(float_t left_x, float_t left_y, float_t right_x, float_t right_y, float_t alpha,
+                           const glm::vec2& to_ndc, TrailVertex* vertices) {
+        vertices[0] = {.position = glm::vec2(left_x, left_y) * to_ndc - 1.0f, .alpha = alpha};
+        vertices[1] = {.position = glm::vec2(right_x, right_y) * to_ndc - 1.0f, .alpha = alpha};
+    }
+
+    // Ends of the strip take the direction of their only segment
+    static void tessellate_point(const TrailPoints& points, size_t i, const glm::vec2& to_ndc, TrailVertex* vertices) {
+        const size_t last = points.size() - 1;
+        const glm::vec2 point(points.x[i], points.y[i]);
+        const glm::vec2 previous = i > 0 ? glm::vec2(points.x[i - 1], points.y[i - 1]) : point;
+        const glm::vec2 next = i < last ? glm::vec2(points.x[i + 1], points.y[i + 1]) : point;
+
+        const glm::vec2 out = get_direction(i < last ? next - point : point - previous);
+        const glm::vec2 in = i > 0 ? get_direction(point - previous) : out;
+
+        // Turns of 180 degrees have no tangent, the outgoing direction stands in
+        const glm::vec2 sum = in + out;
+        const float_t sum_length = glm::length(sum);
+        const glm::vec2 tangent = sum_length > MIN_SEGMENT_LENGTH ? sum / sum_length : out;
+        const glm::vec2 normal(-tangent.y, tangent.x);
+
+        const float_t miter_dot = std::max(normal.x * -out.y + normal.y * out.x, 1.0f / MAX_MITER_SCALE);
+        const glm::vec2 offset = normal * (TRAIL_HALF_WIDTH * points.fade[i] / miter_dot);
+        write_pair(point.x + offset.x, point.y + offset.y, point.x - offset.x, point.y - offset.y, points.fade[i], to_ndc, vertices);
+    }
+
+    uint32_t tessellate_trail_ribbon(const TrailPoints& points, uint16_t width, uint16_t height, TrailVertex* vertices) {
+        const size_t count = points.size();
+        if (count < 2) {
+            return 0;
+        }
+
+        const glm::vec2 to_ndc(2.0f / width, 2.0f / height);
+        tessellate_point(points, 0, to_ndc, vertices);
+
+        size_t i = 1;
+#if defined(__SSE2__)
+        // Interior points four at a time, same operations as tessellate_point
+        const float_t* xs = points.x.data();
+        const float_t* ys = points.y.data();
+        const __m128 min_length = _mm_set1_ps(MIN_SEGMENT_LENGTH);
+        const __m128 min_miter_dot = _mm_set1_ps(1.0f / MAX_MITER_SCALE);
+        const __m128 half_width = _mm_set1_ps(TRAIL_HALF_WIDTH);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        auto get_length = [](__m128 x, __m128 y) {
+            return _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+        };
+
+        for (; i + 4 < count; i += 4) {
+            const __m128 x = _mm_loadu_ps(xs + i);
+            const __m128 y = _mm_loadu_ps(ys + i);
+
+            __m128 in_x = _mm_sub_ps(x, _mm_loadu_ps(xs + i - 1));
+            __m128 in_y = _mm_sub_ps(y, _mm_loadu_ps(ys + i - 1));
+            const __m128 in_length = _mm_max_ps(get_length(in_x, in_y), min_length);
+            in_x = _mm_div_ps(in_x, in_length);
+            in_y = _mm_div_ps(in_y, in_length);
+
+            __m128 out_x = _mm_sub_ps(_mm_loadu_ps(xs + i + 1), x);
+            __m128 out_y = _mm_sub_ps(_mm_loadu_ps(ys + i + 1), y);
+            const __m128 out_length = _mm_max_ps(get_length(out_x, out_y), min_length);
+            out_x = _mm_div_ps(out_x, out_length);
+            out_y = _mm_div_ps(out_y, out_length);
+
+            const __m128 sum_x = _mm_add_ps(in_x, out_x);
+            const __m128 sum_y = _mm_add_ps(in_y, out_y);
+            const __m128 sum_length = get_length(sum_x, sum_y);
+            const __m128 has_tangent = _mm_cmpgt_ps(sum_length, min_length);
+            const __m128 tangent_x = _mm_or_ps(_mm_and_ps(has_tangent, _mm_div_ps(sum_x, sum_length)), _mm_andnot_ps(has_tangent, out_x));
+            const __m128 tangent_y = _mm_or_ps(_mm_and_ps(has_tangent, _mm_div_ps(sum_y, sum_length)), _mm_andnot_ps(has_tangent, out_y));
+
+            // Normal (-tangent.y, tangent.x) against the outgoing normal (-out.y, out.x)
+            const __m128 normal_x = _mm_xor_ps(tangent_y, sign);
+            const __m128 normal_y = tangent_x;
+            const __m128 miter_dot = _mm_max_ps(_mm_add_ps(_mm_mul_ps(normal_x, _mm_xor_ps(out_y, sign)), _mm_mul_ps(normal_y, out_x)),
+                                                min_miter_dot);
+
+            const __m128 fade = _mm_loadu_ps(points.fade.data() + i);
+            const __m128 scale = _mm_div_ps(_mm_mul_ps(half_width, fade), miter_dot);
+            const __m128 offset_x = _mm_mul_ps(normal_x, scale);
+            const __m128 offset_y = _mm_mul_ps(normal_y, scale);
+
+            alignas(16) float_t left_x[4], left_y[4], right_x[4], right_y[4], alpha[4];
+            _mm_store_ps(left_x, _mm_add_ps(x, offset_x));
+            _mm_store_ps(left_y, _mm_add_ps(y, offset_y));
+            _mm_store_ps(right_x, _mm_sub_ps(x, offset_x));
+            _mm_store_ps(right_y, _mm_sub_ps(y, offset_y));
+            _mm_store_ps(alpha, fade);
+            for (size_t lane = 0; lane < 4; lane++) {
+                write_pair(left_x[lane], left_y[lane], right_x[lane], right_y[lane], alpha[lane], to_ndc, vertices + 2 * (i + lane));
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            tessellate_point(points, i, to_ndc, vertices + 2 * i);
+        }
+
+        return static_cast<uint32_t>(2 * count);
+    }
+
+} // namespace leper
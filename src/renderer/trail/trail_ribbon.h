@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_rendering_constants.h"
+#include "../../utils/ring_buffer.h"
+
+namespace leper {
+
+    // Cursor position in framebuffer pixels, y down
+    struct TrailSample {
+        glm::vec2 position;
+        // Seconds, on the clock the trail is faded with
+        double time;
+    };
+
+    using TrailBuffer = RingBuffer<TrailSample, MAX_TRAIL_SAMPLES>;
+
+    // Live trail of a frame in screen pixels, y up, oldest first. Structure of arrays, so the
+    // tessellation reads four neighbouring points per load
+    struct TrailPoints {
+        std::vector<float_t> x;
+        std::vector<float_t> y;
+        // 1 for a new sample down to 0 when it expires, scales both width and alpha
+        std::vector<float_t> fade;
+
+        size_t size() const { return x.size(); }
+        void clear() {
+            x.clear();
+            y.clear();
+            fade.clear();
+        }
+    };
+
+    // Layout read by trail.vert.glsl
+    struct TrailVertex {
+        glm::vec2 position;
+        float_t alpha;
+    };
+
+    // Mitered triangle strip around the trail in the NDC of a width x height screen, two vertices per
+    // point. Returns the vertex count, 0 for trails shorter than one segment
+    uint32_t tessellate_trail_ribbon(const TrailPoints& points, uint16_t width, uint16_t height, TrailVertex* vertices);
+
+} // namespace leper
@@ -0,0 +1,453 @@
+#include "dynamic_aabb_tree.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+namespace leper {
+
+    // World units added around each leaf, and how far ahead the box extends along the displacement
+    constexpr float_t FAT_AABB_MARGIN = 0.1f;
+    constexpr float_t FAT_AABB_DISPLACEMENT_MULTIPLIER = 4.0f;
+
+    constexpr size_t BATCH_SIZE = 64;
+
+    static AABB fatten(const AABB& aabb, const glm::vec3& displacement) {
+        AABB fat = {.min = aabb.min - glm::vec3(FAT_AABB_MARGIN), .max = aabb.max + glm::vec3(FAT_AABB_MARGIN)};
+
+        const glm::vec3 predicted = displacement * FAT_AABB_DISPLACEMENT_MULTIPLIER;
+        fat.min += glm::min(predicted, glm::vec3(0.0f));
+        fat.max += glm::max(predicted, glm::vec3(0.0f));
+        return fat;
+    }
+
+    static glm::vec3 inverse_direction(const glm::vec3& direction) {
+        return glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    }
+
+    int32_t DynamicAabbTree::allocate_node() {
+        if (free_list_ == NULL_PROXY) {
+            nodes_.push_back(TreeNode{});
+            free_list_ = static_cast<int32_t>(nodes_.size() - 1);
+            nodes_.back().parent = NULL_PROXY;
+        }
+
+        const int32_t node = free_list_;
+        free_list_ = nodes_[node].parent;
+        nodes_[node] = TreeNode{.height = 0};
+        return node;
+    }
+
+    void DynamicAabbTree::free_node(int32_t node) {
+        assert(node >= 0 && node < static_cast<int32_t>(nodes_.size()) && "Freeing an invalid node");
+
+        nodes_[node].parent = free_list_;
+        nodes_[node].height = -1;
+        free_list_ = node;
+    }
+
+    ProxyId DynamicAabbTree::create_proxy(const AABB& aabb, Entity entity) {
+        const int32_t proxy = allocate_node();
+
+        TreeNode& node = nodes_[proxy];
+        node.aabb = fatten(aabb, glm::vec3(0.0f));
+        node.tight = aabb;
+        node.entity = entity;
+
+        insert_leaf(proxy);
+        proxy_count_++;
+
+        return proxy;
+    }
+
+    void DynamicAabbTree::destroy_proxy(ProxyId proxy) {
+        assert(proxy >= 0 && proxy < static_cast<int32_t>(nodes_.size()) && nodes_[proxy].is_leaf() && "Destroying an invalid proxy");
+
+        if (nodes_[proxy].pending_reinsertion) {
+            pending_reinsertions_.erase(std::find(pending_reinsertions_.begin(), pending_reinsertions_.end(), proxy));
+        }
+
+        remove_leaf(proxy);
+        free_node(proxy);
+        proxy_count_--;
+    }
+
+    bool DynamicAabbTree::move_proxy(ProxyId proxy, const AABB& aabb, const glm::vec3& displacement) {
+        assert(proxy >= 0 && proxy < static_cast<int32_t>(nodes_.size()) && nodes_[proxy].is_leaf() && "Moving an invalid proxy");
+
+        TreeNode& node = nodes_[proxy];
+        node.tight = aabb;
+
+        if (contains(node.aabb, aabb)) {
+            return false;
+        }
+
+        // Keep the tree valid right away by growing the ancestors. The leaf gets
+        // a proper spot once the reinsertion budget allows it
+        node.aabb = fatten(aabb, displacement);
+        refit_ancestors(node.parent);
+
+        if (!node.pending_reinsertion) {
+            node.pending_reinsertion = true;
+            pending_reinsertions_.push_back(proxy);
+        }
+        return true;
+    }
+
+    void DynamicAabbTree::update(size_t max_reinsertions) {
+        const size_t count = std::min(max_reinsertions, pending_reinsertions_.size());
+
+        // Oldest first
+        for (size_t i = 0; i < count; i++) {
+            const ProxyId proxy = pending_reinsertions_[i];
+            nodes_[proxy].pending_reinsertion = false;
+
+            remove_leaf(proxy);
+            insert_leaf(proxy);
+        }
+        pending_reinsertions_.erase(pending_reinsertions_.begin(), pending_reinsertions_.begin() + count);
+    }
+
+    const AABB& DynamicAabbTree::get_fat_aabb(ProxyId proxy) const {
+        return nodes_[proxy].aabb;
+    }
+
+    const AABB& DynamicAabbTree::get_aabb(ProxyId proxy) const {
+        return nodes_[proxy].tight;
+    }
+
+    Entity DynamicAabbTree::get_entity(ProxyId proxy) const {
+        return nodes_[proxy].entity;
+    }
+
+    int32_t DynamicAabbTree::get_height() const {
+        return root_ == NULL_PROXY ? 0 : nodes_[root_].height;
+    }
+
+    void DynamicAabbTree::refit_ancestors(int32_t node) {
+        while (node != NULL_PROXY) {
+            TreeNode& current = nodes_[node];
+            const AABB refitted = merge(nodes_[current.child_1].aabb, nodes_[current.child_2].aabb);
+            if (contains(current.aabb, refitted)) {
+                // Ancestors already enclose it
+                return;
+            }
+            current.aabb = refitted;
+            node = current.parent;
+        }
+    }
+
+    // Descends towards the sibling with the lowest surface area increase
+    void DynamicAabbTree::insert_leaf(int32_t leaf) {
+        if (root_ == NULL_PROXY) {
+            root_ = leaf;
+            nodes_[root_].parent = NULL_PROXY;
+            return;
+        }
+
+        const AABB leaf_aabb = nodes_[leaf].aabb;
+        int32_t index = root_;
+        while (!nodes_[index].is_leaf()) {
+            const int32_t child_1 = nodes_[index].child_1;
+            const int32_t child_2 = nodes_[index].child_2;
+
+            const float_t area = surface_area(nodes_[index].aabb);
+            const float_t combined_area = surface_area(merge(nodes_[index].aabb, leaf_aabb));
+
+            // Cost of creating a new parent for this node and the new leaf
+            const float_t cost = 2.0f * combined_area;
+            // Minimum cost of pushing the leaf further down the tree
+            const float_t inheritance_cost = 2.0f * (combined_area - area);
+
+            auto descend_cost = [&](int32_t child) {
+                const float_t new_area = surface_area(merge(leaf_aabb, nodes_[child].aabb));
+                if (nodes_[child].is_leaf()) {
+                    return new_area + inheritance_cost;
+                }
+                return new_area - surface_area(nodes_[child].aabb) + inheritance_cost;
+            };
+            const float_t cost_1 = descend_cost(child_1);
+            const float_t cost_2 = descend_cost(child_2);
+
+            if (cost < cost_1 && cost < cost_2) {
+                break;
+            }
+            index = cost_1 < cost_2 ? child_1 : child_2;
+        }
+
+        const int32_t sibling = index;
+        const int32_t old_parent = nodes_[sibling].parent;
+        const int32_t new_parent = allocate_node();
+
+        nodes_[new_parent].parent = old_parent;
+        nodes_[new_parent].aabb = merge(leaf_aabb, nodes_[sibling].aabb);
+        nodes_[new_parent].height = nodes_[sibling].height + 1;
+        nodes_[new_parent].child_1 = sibling;
+        nodes_[new_parent].child_2 = leaf;
+        nodes_[sibling].parent = new_parent;
+        nodes_[leaf].parent = new_parent;
+
+        if (old_parent != NULL_PROXY) {
+            if (nodes_[old_parent].child_1 == sibling) {
+                nodes_[old_parent].child_1 = new_parent;
+            } else {
+                nodes_[old_parent].child_2 = new_parent;
+            }
+        } else {
+            root_ = new_parent;
+        }
+
+        // Walk back up fixing heights and boxes
+        index = nodes_[leaf].parent;
+        while (index != NULL_PROXY) {
+            index = balance(index);
+
+            TreeNode& node = nodes_[index];
+            node.height = 1 + std::max(nodes_[node.child_1].height, nodes_[node.child_2].height);
+            node.aabb = merge(nodes_[node.child_1].aabb, nodes_[node.child_2].aabb);
+
+            index = node.parent;
+        }
+    }
+
+    void DynamicAabbTree::remove_leaf(int32_t leaf) {
+        if (leaf == root_) {
+            root_ = NULL_PROXY;
+            return;
+        }
+
+        const int32_t parent = nodes_[leaf].parent;
+        const int32_t grand_parent = nodes_[parent].parent;
+        const int32_t sibling = nodes_[parent].child_1 == leaf ? nodes_[parent].child_2 : nodes_[parent].child_1;
+
+        if (grand_parent == NULL_PROXY) {
+            root_ = sibling;
+            nodes_[sibling].parent = NULL_PROXY;
+            free_node(parent);
+            return;
+        }
+
+        // Destroy the parent and connect the sibling to the grand parent
+        if (nodes_[grand_parent].child_1 == parent) {
+            nodes_[grand_parent].child_1 = sibling;
+        } else {
+            nodes_[grand_parent].child_2 = sibling;
+        }
+        nodes_[sibling].parent = grand_parent;
+        free_node(parent);
+
+        int32_t index = grand_parent;
+        while (index != NULL_PROXY) {
+            index = balance(index);
+
+            TreeNode& node = nodes_[index];
+            node.aabb = merge(nodes_[node.child_1].aabb, nodes_[node.child_2].aabb);
+            node.height = 1 + std::max(nodes_[node.child_1].height, nodes_[node.child_2].height);
+
+            index = node.parent;
+        }
+    }
+
+    // Rotates the subtree rooted at `i_a` if it is imbalanced, returns the new subtree root
+    int32_t DynamicAabbTree::balance(int32_t i_a) {
+        TreeNode& a = nodes_[i_a];
+        if (a.is_leaf() || a.height < 2) {
+            return i_a;
+        }
+
+        const int32_t i_b = a.child_1;
+        const int32_t i_c = a.child_2;
+        TreeNode& b = nodes_[i_b];
+        TreeNode& c = nodes_[i_c];
+
+        const int32_t balance = c.height - b.height;
+
+        auto replace_in_parent = [&](int32_t old_child, int32_t new_child) {
+            const int32_t parent = nodes_[new_child].parent;
+            if (parent == NULL_PROXY) {
+                root_ = new_child;
+            } else if (nodes_[parent].child_1 == old_child) {
+                nodes_[parent].child_1 = new_child;
+            } else {
+                nodes_[parent].child_2 = new_child;
+            }
+        };
+
+        // Rotate C up
+        if (balance > 1) {
+            const int32_t i_f = c.child_1;
+            const int32_t i_g = c.child_2;
+            TreeNode& f = nodes_[i_f];
+            TreeNode& g = nodes_[i_g];
+
+            c.child_1 = i_a;
+            c.parent = a.parent;
+            a.parent = i_c;
+            replace_in_parent(i_a, i_c);
+
+            if (f.height > g.height) {
+                c.child_2 = i_f;
+                a.child_2 = i_g;
+                g.parent = i_a;
+                a.aabb = merge(b.aabb, g.aabb);
+                c.aabb = merge(a.aabb, f.aabb);
+                a.height = 1 + std::max(b.height, g.height);
+                c.height = 1 + std::max(a.height, f.height);
+            } else {
+                c.child_2 = i_g;
+                a.child_2 = i_f;
+                f.parent = i_a;
+                a.aabb = merge(b.aabb, f.aabb);
+                c.aabb = merge(a.aabb, g.aabb);
+                a.height = 1 + std::max(b.height, f.height);
+                c.height = 1 + std::max(a.height, g.height);
+            }
+            return i_c;
+        }
+
+        // Rotate B up
+        if (balance < -1) {
+            const int32_t i_d = b.child_1;
+            const int32_t i_e = b.child_2;
+            TreeNode& d = nodes_[i_d];
+            TreeNode& e = nodes_[i_e];
+
+            b.child_1 = i_a;
+            b.parent = a.parent;
+            a.parent = i_b;
+            replace_in_parent(i_a, i_b);
+
+            if (d.height > e.height) {
+                b.child_2 = i_d;
+                a.child_1 = i_e;
+                e.parent = i_a;
+                a.aabb = merge(c.aabb, e.aabb);
+                b.aabb = merge(a.aabb, d.aabb);
+                a.height = 1 + std::max(c.height, e.height);
+                b.height = 1 + std::max(a.height, d.height);
+            } else {
+                b.child_2 = i_e;
+                a.child_1 = i_d;
+                d.parent = i_a;
+                a.aabb = merge(c.aabb, d.aabb);
+                b.aabb = merge(a.aabb, e.aabb);
+                a.height = 1 + std::max(c.height, d.height);
+                b.height = 1 + std::max(a.height, e.height);
+            }
+            return i_b;
+        }
+
+        return i_a;
+    }
+
+    void DynamicAabbTree::query_aabb(const AABB& aabb, std::vector<Entity>& result) const {
+        query([&](const AABB& node_aabb) { return overlaps(node_aabb, aabb); },
+              [&](ProxyId proxy) { result.push_back(nodes_[proxy].entity); return true; });
+    }
+
+    void DynamicAabbTree::query_sphere(const Sphere& sphere, std::vector<Entity>& result) const {
+        query([&](const AABB& node_aabb) { return intersects(sphere, node_aabb); },
+              [&](ProxyId proxy) { result.push_back(nodes_[proxy].entity); return true; });
+    }
+
+    void DynamicAabbTree::query_frustum(const Frustum& frustum, std::vector<Entity>& result) const {
+        query([&](const AABB& node_aabb) { return intersects(frustum, node_aabb); },
+              [&](ProxyId proxy) { result.push_back(nodes_[proxy].entity); return true; });
+    }
+
+    RayHit DynamicAabbTree::raycast(const Ray& ray) const {
+        RayHit closest = {};
+        raycast_batch(&ray, 1, &closest);
+        return closest;
+    }
+
+    // Every node is tested against all the queries still alive in its parent, tracked in a
+    // 64 bits mask, so the tree is walked once per group of 64 queries
+    template <typename Overlap, typename Emit>
+    void DynamicAabbTree::batch_query(size_t count, Overlap&& overlap, Emit&& emit) const {
+        if (root_ == NULL_PROXY) {
+            return;
+        }
+
+        std::vector<std::pair<int32_t, uint64_t>> stack;
+        stack.reserve(64);
+
+        for (size_t first = 0; first < count; first += BATCH_SIZE) {
+            const size_t batch_count = std::min(BATCH_SIZE, count - first);
+            const uint64_t all_queries = batch_count == BATCH_SIZE ? ~0ull : (1ull << batch_count) - 1;
+
+            stack.push_back({root_, all_queries});
+            while (!stack.empty()) {
+                const auto [index, parent_mask] = stack.back();
+                stack.pop_back();
+                const TreeNode& node = nodes_[index];
+
+                uint64_t mask = 0;
+                for (uint64_t bits = parent_mask; bits; bits &= bits - 1) {
+                    const int bit = std::countr_zero(bits);
+                    if (overlap(first + bit, node.aabb)) {
+                        mask |= 1ull << bit;
+                    }
+                }
+                if (mask == 0) {
+                    continue;
+                }
+
+                if (node.is_leaf()) {
+                    for (uint64_t bits = mask; bits; bits &= bits - 1) {
+                        const size_t query_index = first + std::countr_zero(bits);
+                        if (overlap(query_index, node.tight)) {
+                            emit(query_index, index);
+                        }
+                    }
+                } else {
+                    stack.push_back({node.child_1, mask});
+                    stack.push_back({node.child_2, mask});
+                }
+            }
+        }
+    }
+
+    void DynamicAabbTree::query_aabbs(const AABB* aabbs, size_t count, std::vector<BatchHit>& hits) const {
+        batch_query(
+            count,
+            [&](size_t query, const AABB& node_aabb) { return overlaps(node_aabb, aabbs[query]); },
+            [&](size_t query, int32_t proxy) { hits.push_back({static_cast<uint32_t>(query), nodes_[proxy].entity}); });
+    }
+
+    void DynamicAabbTree::query_spheres(const Sphere* spheres, size_t count, std::vector<BatchHit>& hits) const {
+        batch_query(
+            count,
+            [&](size_t query, const AABB& node_aabb) { return intersects(spheres[query], node_aabb); },
+            [&](size_t query, int32_t proxy) { hits.push_back({static_cast<uint32_t>(query), nodes_[proxy].entity}); });
+    }
+
+    void DynamicAabbTree::query_frustums(const Frustum* frustums, size_t count, std::vector<BatchHit>& hits) const {
+        batch_query(
+            count,
+            [&](size_t query, const AABB& node_aabb) { return intersects(frustums[query], node_aabb); },
+            [&](size_t query, int32_t proxy) { hits.push_back({static_cast<uint32_t>(query), nodes_[proxy].entity}); });
+    }
+
+    // Nodes further than the closest hit found so far for a ray are pruned for that ray
+    void DynamicAabbTree::raycast_batch(const Ray* rays, size_t count, RayHit* hits) const {
+        std::vector<glm::vec3> inv_directions(count);
+        for (size_t i = 0; i < count; i++) {
+            inv_directions[i] = inverse_direction(rays[i].direction);
+            hits[i] = {};
+        }
+
+        batch_query(
+            count,
+            [&](size_t query, const AABB& node_aabb) {
+                const float_t t = intersect_ray(rays[query], inv_directions[query], node_aabb);
+                return t >= 0.0f && (!hits[query].hit() || t < hits[query].distance);
+            },
+            [&](size_t query, int32_t proxy) {
+                hits[query] = {.entity = nodes_[proxy].entity,
+                               .distance = intersect_ray(rays[query], inv_directions[query], nodes_[proxy].tight)};
+            });
+    }
+
+} // namespace leper
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_ecs_types.h"
+#include "../math/bounds.h"
+
+namespace leper {
+
+    using ProxyId = int32_t;
+    constexpr ProxyId NULL_PROXY = -1;
+
+    // Hit of a batched query: which query of the batch touched which entity
+    struct BatchHit {
+        uint32_t query;
+        Entity entity;
+    };
+
+    struct RayHit {
+        Entity entity = 0;
+        float_t distance = -1.0f;
+
+        bool hit() const { return distance >= 0.0f; }
+    };
+
+    // Incremental bounding volume hierarchy over entity bounds (inspired by Box2D's b2DynamicTree).
+    // Leaves store a fattened box so small movements don't touch the tree at all. Leaves that
+    // escape it are refitted in place right away and reinserted later, within a per frame budget.
+    class DynamicAabbTree {
+      public:
+        ProxyId create_proxy(const AABB& aabb, Entity entity);
+        void destroy_proxy(ProxyId proxy);
+        // Returns true when the leaf escaped its fat box
+        bool move_proxy(ProxyId proxy, const AABB& aabb, const glm::vec3& displacement);
+
+        // Reinserts up to `max_reinsertions` leaves that escaped their fat box
+        void update(size_t max_reinsertions);
+
+        const AABB& get_fat_aabb(ProxyId proxy) const;
+        const AABB& get_aabb(ProxyId proxy) const;
+        Entity get_entity(ProxyId proxy) const;
+        size_t get_proxy_count() const { return proxy_count_; }
+        size_t get_pending_reinsertions() const { return pending_reinsertions_.size(); }
+        int32_t get_height() const;
+
+        // Callback receives the proxy and returns false to stop the traversal
+        template <typename Overlap, typename Callback>
+        void query(Overlap&& overlap, Callback&& callback) const;
+
+        void query_aabb(const AABB& aabb, std::vector<Entity>& result) const;
+        void query_sphere(const Sphere& sphere, std::vector<Entity>& result) const;
+        void query_frustum(const Frustum& frustum, std::vector<Entity>& result) const;
+        RayHit raycast(const Ray& ray) const;
+
+        // Batched versions run every query of the batch in a single traversal
+        void query_aabbs(const AABB* aabbs, size_t count, std::vector<BatchHit>& hits) const;
+        void query_spheres(const Sphere* spheres, size_t count, std::vector<BatchHit>& hits) const;
+        void query_frustums(const Frustum* frustums, size_t count, std::vector<BatchHit>& hits) const;
+        void raycast_batch(const Ray* rays, size_t count, RayHit* hits) const;
+
+      private:
+        struct TreeNode {
+            // Fat box for leaves, union of the children otherwise
+            AABB aabb = {};
+            // Exact bounds, leaves only
+            AABB tight = {};
+
+            // Parent, or next free node when in the free list
+            int32_t parent = NULL_PROXY;
+            int32_t child_1 = NULL_PROXY;
+            int32_t child_2 = NULL_PROXY;
+            // 0 for leaves, -1 for free nodes
+            int32_t height = -1;
+
+            Entity entity = 0;
+            bool pending_reinsertion = false;
+
+            bool is_leaf() const { return child_1 == NULL_PROXY; }
+        };
+
+        int32_t allocate_node();
+        void free_node(int32_t node);
+
+        void insert_leaf(int32_t leaf);
+        void remove_leaf(int32_t leaf);
+        int32_t balance(int32_t node);
+        void refit_ancestors(int32_t node);
+
+        template <typename Overlap, typename Emit>
+        void batch_query(size_t count, Overlap&& overlap, Emit&& emit) const;
+
+        std::vector<TreeNode> nodes_;
+        int32_t root_ = NULL_PROXY;
+        int32_t free_list_ = NULL_PROXY;
+        size_t proxy_count_ = 0;
+
+        std::vector<ProxyId> pending_reinsertions_;
+    };
+
+    // Small stack for tree traversals that only touches the heap for very deep trees
+    class TraversalStack {
+      public:
+        void push(int32_t node) {
+            if (size_ < inline_.size()) {
+                inline_[size_++] = node;
+            } else {
+                overflow_.push_back(node);
+            }
+        }
+        int32_t pop() {
+            if (!overflow_.empty()) {
+                int32_t node = overflow_.back();
+                overflow_.pop_back();
+                return node;
+            }
+            return inline_[--size_];
+        }
+        bool empty() const { return size_ == 0 && overflow_.empty(); }
+
+      private:
+        std::array<int32_t, 128> inline_;
+        size_t size_ = 0;
+        std::vector<int32_t> overflow_;
+    };
+
+    template <typename Overlap, typename Callback>
+    void DynamicAabbTree::query(Overlap&& overlap, Callback&& callback) const {
+        if (root_ == NULL_PROXY) {
+            return;
+        }
+
+        TraversalStack stack;
+        stack.push(root_);
+
+        while (!stack.empty()) {
+            const int32_t index = stack.pop();
+            const TreeNode& node = nodes_[index];
+
+            if (!overlap(node.aabb)) {
+                continue;
+            }
+
+            if (node.is_leaf()) {
+                if (overlap(node.tight) && !callback(index)) {
+                    return;
+                }
+            } else {
+                stack.push(node.child_1);
+                stack.push(node.child_2);
+            }
+        }
+    }
+
+} // namespace leper
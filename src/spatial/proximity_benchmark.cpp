@@ -0,0 +1,133 @@
+#include "proximity_benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "spatial_hash_grid.h"
+
+namespace leper {
+
+    // Same cell size as ProximitySystem
+    constexpr float_t BENCHMARK_CELL_SIZE = 2.0f;
+    // Square meters per agent
+    constexpr float_t BENCHMARK_AREA_PER_AGENT = 16.0f;
+    constexpr float_t BENCHMARK_QUERY_RADIUS = 3.0f;
+    constexpr size_t BENCHMARK_QUERY_COUNT = 500;
+    constexpr size_t BENCHMARK_NEAREST_K = 8;
+    constexpr float_t BENCHMARK_NEAREST_RADIUS = 20.0f;
+    // Each timing is the mean of this many runs
+    constexpr uint32_t BENCHMARK_REPEATS = 10;
+    constexpr uint32_t BENCHMARK_SEED = 2;
+
+    template <typename Fn>
+    static double time_milliseconds(Fn&& fn) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BENCHMARK_REPEATS; i++) {
+            fn();
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / BENCHMARK_REPEATS;
+    }
+
+    // Brute force reference, sorted by entity
+    static void scan_radius(const std::vector<glm::vec3>& positions, const glm::vec3& center, float_t radius,
+                            std::vector<Entity>& result) {
+        result.clear();
+        for (size_t i = 0; i < positions.size(); i++) {
+            const glm::vec3 d = positions[i] - center;
+            if (glm::dot(d, d) <= radius * radius) {
+                result.push_back(static_cast<Entity>(i));
+            }
+        }
+    }
+
+    // Counts the queries whose k nearest differ from a full sort by distance. Ties may come
+    // in another order, so distances are compared and not entities
+    static size_t count_nearest_mismatches(const SpatialHashGrid& grid, const std::vector<glm::vec3>& positions, ThreadPool* pool) {
+        std::vector<Entity> results(BENCHMARK_QUERY_COUNT * BENCHMARK_NEAREST_K);
+        std::vector<uint32_t> result_counts(BENCHMARK_QUERY_COUNT);
+        grid.query_nearest_batch(positions.data(), BENCHMARK_QUERY_COUNT, BENCHMARK_NEAREST_K, BENCHMARK_NEAREST_RADIUS,
+                                 results.data(), result_counts.data(), pool);
+
+        size_t mismatches = 0;
+        std::vector<float_t> distances;
+        for (size_t query = 0; query < BENCHMARK_QUERY_COUNT; query++) {
+            const glm::vec3& center = positions[query];
+            distances.clear();
+            for (const glm::vec3& position : positions) {
+                const float_t distance = glm::distance(position, center);
+                if (distance <= BENCHMARK_NEAREST_RADIUS) {
+                    distances.push_back(distance);
+                }
+            }
+            std::sort(distances.begin(), distances.end());
+
+            const size_t expected = std::min(BENCHMARK_NEAREST_K, distances.size());
+            bool matches = result_counts[query] == expected;
+            for (size_t j = 0; matches && j < expected; j++) {
+                matches = glm::distance(positions[results[query * BENCHMARK_NEAREST_K + j]], center) == distances[j];
+            }
+            mismatches += matches ? 0 : 1;
+        }
+        return mismatches;
+    }
+
+    bool run_proximity_benchmark(ThreadPool* pool) {
+        spdlog::info("{} radius {} queries per run, {} m2 per agent, mean of {} runs, pool of {} threads",
+                     BENCHMARK_QUERY_COUNT, BENCHMARK_QUERY_RADIUS, BENCHMARK_AREA_PER_AGENT, BENCHMARK_REPEATS,
+                     pool ? pool->get_thread_count() : 1);
+
+        bool all_match = true;
+        for (const size_t agent_count : {size_t{1000}, size_t{10000}, size_t{100000}}) {
+            // Agents on the ground plane, the first ones are also the query centers
+            std::mt19937 rng(BENCHMARK_SEED);
+            const float_t half_side = 0.5f * std::sqrt(agent_count * BENCHMARK_AREA_PER_AGENT);
+            std::uniform_real_distribution<float_t> coordinate(-half_side, half_side);
+            std::vector<glm::vec3> positions(agent_count);
+            std::vector<Entity> entities(agent_count);
+            for (size_t i = 0; i < agent_count; i++) {
+                const float_t x = coordinate(rng);
+                const float_t z = coordinate(rng);
+                positions[i] = glm::vec3(x, 0.0f, z);
+                entities[i] = static_cast<Entity>(i);
+            }
+
+            SpatialHashGrid grid(BENCHMARK_CELL_SIZE, static_cast<uint32_t>(2 * agent_count));
+            std::vector<std::vector<Entity>> results(BENCHMARK_QUERY_COUNT);
+            std::vector<std::vector<Entity>> expected(BENCHMARK_QUERY_COUNT);
+
+            const double build_ms = time_milliseconds([&] { grid.build(positions.data(), entities.data(), agent_count); });
+            const double grid_ms = time_milliseconds([&] {
+                grid.query_radius_batch(positions.data(), BENCHMARK_QUERY_COUNT, BENCHMARK_QUERY_RADIUS, results.data());
+            });
+            const double pool_ms = time_milliseconds([&] {
+                grid.query_radius_batch(positions.data(), BENCHMARK_QUERY_COUNT, BENCHMARK_QUERY_RADIUS, results.data(), pool);
+            });
+            const double brute_force_ms = time_milliseconds([&] {
+                for (size_t query = 0; query < BENCHMARK_QUERY_COUNT; query++) {
+                    scan_radius(positions, positions[query], BENCHMARK_QUERY_RADIUS, expected[query]);
+                }
+            });
+
+            size_t radius_mismatches = 0;
+            for (size_t query = 0; query < BENCHMARK_QUERY_COUNT; query++) {
+                std::sort(results[query].begin(), results[query].end());
+                radius_mismatches += results[query] == expected[query] ? 0 : 1;
+            }
+            const size_t nearest_mismatches = count_nearest_mismatches(grid, positions, pool);
+            all_match = all_match && radius_mismatches == 0 && nearest_mismatches == 0;
+
+            spdlog::info("{:>6} agents: build {:.3f} ms, grid {:.3f} ms, grid on the pool {:.3f} ms, brute force {:.3f} ms, "
+                         "{} radius and {} k nearest mismatches",
+                         agent_count, build_ms, grid_ms, pool_ms, brute_force_ms, radius_mismatches, nearest_mismatches);
+        }
+        return all_match;
+    }
+
+} // namespace leper
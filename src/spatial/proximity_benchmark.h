@@ -0,0 +1,13 @@
+#pragma once
+
+#include "../utils/thread_pool.h"
+
+namespace leper {
+
+    // Times SpatialHashGrid builds and radius queries against a brute force scan at
+    // 1k, 10k and 100k agents spread at constant density, and checks that the radius
+    // and k nearest results match it. Logs one line per agent count and returns
+    // whether every result matched
+    bool run_proximity_benchmark(ThreadPool* pool);
+
+} // namespace leper
@@ -0,0 +1,181 @@
+#include "spatial_hash_grid.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+namespace leper {
+
+    // Queries per chunk handed to the pool
+    constexpr size_t QUERY_GRAIN = 64;
+    // Upper bound on neighbours tracked by the k nearest queries
+    constexpr size_t MAX_NEAREST = 64;
+
+    SpatialHashGrid::SpatialHashGrid(float_t cell_size, uint32_t bucket_count)
+        : cell_size_(cell_size), inv_cell_size_(1.0f / cell_size), bucket_mask_(std::bit_ceil(bucket_count) - 1) {
+        assert(cell_size > 0.0f && "Grid cell size must be positive");
+        bucket_starts_.assign(bucket_mask_ + 2, 0);
+    }
+
+    glm::ivec3 SpatialHashGrid::get_cell(const glm::vec3& position) const {
+        return glm::ivec3(glm::floor(position * inv_cell_size_));
+    }
+
+    uint32_t SpatialHashGrid::get_bucket(const glm::ivec3& cell) const {
+        // Teschner et al. 2003
+        const uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^
+                              (static_cast<uint32_t>(cell.y) * 19349663u) ^
+                              (static_cast<uint32_t>(cell.z) * 83492791u);
+        return hash & bucket_mask_;
+    }
+
+    void SpatialHashGrid::build(const glm::vec3* positions, const Entity* entities, size_t count) {
+        point_buckets_.resize(count);
+        points_.resize(count);
+        std::fill(bucket_starts_.begin(), bucket_starts_.end(), 0);
+
+        // Counting sort by bucket
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t bucket = get_bucket(get_cell(positions[i]));
+            point_buckets_[i] = bucket;
+            bucket_starts_[bucket + 1]++;
+        }
+        for (size_t b = 1; b < bucket_starts_.size(); b++) {
+            bucket_starts_[b] += bucket_starts_[b - 1];
+        }
+
+        // Scatter using the bucket starts as cursors, which leaves each one at the
+        // end of its bucket, then shift them back by one bucket
+        for (size_t i = 0; i < count; i++) {
+            points_[bucket_starts_[point_buckets_[i]]++] = {positions[i], entities[i]};
+        }
+        for (size_t b = bucket_starts_.size() - 1; b > 0; b--) {
+            bucket_starts_[b] = bucket_starts_[b - 1];
+        }
+        bucket_starts_[0] = 0;
+    }
+
+    template <typename Fn>
+    void SpatialHashGrid::for_each_point(const glm::ivec3& cell, Fn&& fn) const {
+        const uint32_t bucket = get_bucket(cell);
+        const uint32_t end = bucket_starts_[bucket + 1];
+
+        for (uint32_t i = bucket_starts_[bucket]; i < end; i++) {
+            // Other cells may hash to the same bucket
+            if (get_cell(points_[i].position) == cell) {
+                fn(points_[i]);
+            }
+        }
+    }
+
+    void SpatialHashGrid::query_radius(const glm::vec3& center, float_t radius, std::vector<Entity>& result) const {
+        const glm::ivec3 min_cell = get_cell(center - glm::vec3(radius));
+        const glm::ivec3 max_cell = get_cell(center + glm::vec3(radius));
+        const float_t radius_sq = radius * radius;
+
+        for (int32_t z = min_cell.z; z <= max_cell.z; z++) {
+            for (int32_t y = min_cell.y; y <= max_cell.y; y++) {
+                for (int32_t x = min_cell.x; x <= max_cell.x; x++) {
+                    for_each_point(glm::ivec3(x, y, z), [&](const GridPoint& point) {
+                        const glm::vec3 d = point.position - center;
+                        if (glm::dot(d, d) <= radius_sq) {
+                            result.push_back(point.entity);
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+    size_t SpatialHashGrid::query_nearest(const glm::vec3& center, size_t k, float_t max_radius, Entity* result) const {
+        k = std::min(k, MAX_NEAREST);
+        if (k == 0) {
+            return 0;
+        }
+
+        struct Candidate {
+            float_t distance_sq;
+            Entity entity;
+        };
+        Candidate best[MAX_NEAREST];
+        size_t found = 0;
+
+        const float_t max_radius_sq = max_radius * max_radius;
+        const glm::ivec3 center_cell = get_cell(center);
+        const int32_t max_ring = static_cast<int32_t>(std::ceil(max_radius * inv_cell_size_));
+
+        auto consider = [&](const GridPoint& point) {
+            const glm::vec3 d = point.position - center;
+            const float_t distance_sq = glm::dot(d, d);
+            if (distance_sq > max_radius_sq || (found == k && distance_sq >= best[k - 1].distance_sq)) {
+                return;
+            }
+
+            // Insertion into the sorted list, dropping the farthest when full
+            size_t slot = found < k ? found++ : k - 1;
+            while (slot > 0 && best[slot - 1].distance_sq > distance_sq) {
+                best[slot] = best[slot - 1];
+                slot--;
+            }
+            best[slot] = {distance_sq, point.entity};
+        };
+
+        // Visit shells of cells around the center until the k-th best is closer than any unvisited cell
+        for (int32_t ring = 0; ring <= max_ring; ring++) {
+            for (int32_t z = -ring; z <= ring; z++) {
+                for (int32_t y = -ring; y <= ring; y++) {
+                    const bool is_face = std::abs(z) == ring || std::abs(y) == ring;
+                    // Inside the shell only the two x extremities are new
+                    const int32_t step = is_face || ring == 0 ? 1 : 2 * ring;
+                    for (int32_t x = -ring; x <= ring; x += step) {
+                        for_each_point(center_cell + glm::ivec3(x, y, z), consider);
+                    }
+                }
+            }
+
+            // Cells past this shell are at least `ring * cell_size` away from the center
+            const float_t ring_distance = static_cast<float_t>(ring) * cell_size_;
+            if (found == k && best[k - 1].distance_sq <= ring_distance * ring_distance) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < found; i++) {
+            result[i] = best[i].entity;
+        }
+        return found;
+    }
+
+    void SpatialHashGrid::query_radius_batch(const glm::vec3* centers, size_t count, float_t radius,
+                                             std::vector<Entity>* results, ThreadPool* pool) const {
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                results[i].clear();
+                query_radius(centers[i], radius, results[i]);
+            }
+        };
+
+        if (pool) {
+            pool->parallel_for(count, QUERY_GRAIN, run);
+        } else {
+            run(0, count);
+        }
+    }
+
+    void SpatialHashGrid::query_nearest_batch(const glm::vec3* centers, size_t count, size_t k, float_t max_radius,
+                                              Entity* results, uint32_t* result_counts, ThreadPool* pool) const {
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                result_counts[i] = static_cast<uint32_t>(query_nearest(centers[i], k, max_radius, results + i * k));
+            }
+        };
+
+        if (pool) {
+            pool->parallel_for(count, QUERY_GRAIN, run);
+        } else {
+            run(0, count);
+        }
+    }
+
+} // namespace leper
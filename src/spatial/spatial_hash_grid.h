@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "leper/leper_common_types.h"
+#include "leper/leper_ecs_types.h"
+#include "../utils/thread_pool.h"
+
+namespace leper {
+
+    // Uniform grid over moving points, for small radius queries at high rates.
+    // Cells are hashed into a fixed size table and the points are counting sorted
+    // by bucket on every build, so each bucket is one contiguous run of memory.
+    class SpatialHashGrid {
+      public:
+        // `bucket_count` is rounded up to a power of two
+        SpatialHashGrid(float_t cell_size, uint32_t bucket_count);
+
+        void build(const glm::vec3* positions, const Entity* entities, size_t count);
+
+        void query_radius(const glm::vec3& center, float_t radius, std::vector<Entity>& result) const;
+        // Writes at most k entities sorted by distance and returns how many were found
+        size_t query_nearest(const glm::vec3& center, size_t k, float_t max_radius, Entity* result) const;
+
+        // One result vector per query, cleared first. Runs on the pool when given one
+        void query_radius_batch(const glm::vec3* centers, size_t count, float_t radius,
+                                std::vector<Entity>* results, ThreadPool* pool = nullptr) const;
+        // `results` holds k entries per query and `result_counts` how many of them were found
+        void query_nearest_batch(const glm::vec3* centers, size_t count, size_t k, float_t max_radius,
+                                 Entity* results, uint32_t* result_counts, ThreadPool* pool = nullptr) const;
+
+        size_t get_point_count() const { return points_.size(); }
+        float_t get_cell_size() const { return cell_size_; }
+
+      private:
+        struct GridPoint {
+            glm::vec3 position;
+            Entity entity;
+        };
+
+        glm::ivec3 get_cell(const glm::vec3& position) const;
+        uint32_t get_bucket(const glm::ivec3& cell) const;
+
+        template <typename Fn>
+        void for_each_point(const glm::ivec3& cell, Fn&& fn) const;
+
+        float_t cell_size_;
+        float_t inv_cell_size_;
+        uint32_t bucket_mask_;
+
+        // bucket_starts_[b] .. bucket_starts_[b + 1] is the run of points in bucket b
+        std::vector<uint32_t> bucket_starts_;
+        std::vector<GridPoint> points_;
+        std::vector<uint32_t> point_buckets_;
+    };
+
+} // namespace leper
@@ -0,0 +1,70 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+namespace leper {
+
+    FileWatcher::FileWatcher(const std::filesystem::path& directory) {
+#if defined(__linux__)
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) {
+            spdlog::warn("Could not create an inotify instance, {} is not watched", directory.string());
+            return;
+        }
+
+        // Editors either write in place or rename a new file over the old one
+        if (inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            spdlog::warn("Could not watch {}", directory.string());
+            close(fd_);
+            fd_ = -1;
+        }
+#endif
+    }
+
+    FileWatcher::~FileWatcher() {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+
+    std::vector<std::string> FileWatcher::poll() {
+        std::vector<std::string> changed;
+#if defined(__linux__)
+        if (fd_ < 0) {
+            return changed;
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        // Fails with EAGAIN once the queue is drained
+        ssize_t length;
+        while ((length = read(fd_, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    spdlog::warn("File watcher queue overflowed, some changes were missed");
+                }
+                if (event->len == 0 || (event->mask & IN_ISDIR)) {
+                    continue;
+                }
+
+                const std::string name(event->name);
+                if (std::find(changed.begin(), changed.end(), name) == changed.end()) {
+                    changed.push_back(name);
+                }
+            }
+        }
+#endif
+        return changed;
+    }
+
+} // namespace leper
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace leper {
+
+    // Reports the files written in one directory without blocking. Uses inotify, so on other
+    // platforms nothing is ever reported
+    class FileWatcher {
+      public:
+        explicit FileWatcher(const std::filesystem::path& directory);
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        // Names relative to the directory of the files written since the last call, each once
+        std::vector<std::string> poll();
+        bool is_watching() const { return fd_ >= 0; }
+
+      private:
+        int fd_ = -1;
+    };
+
+} // namespace leper
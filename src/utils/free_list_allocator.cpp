@@ -0,0 +1,71 @@
+#include "free_list_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace leper {
+
+    FreeListAllocator::FreeListAllocator(uint32_t capacity)
+        : capacity_(capacity), free_size_(capacity) {
+        if (capacity > 0) {
+            free_blocks_.push_back({.offset = 0, .size = capacity});
+        }
+    }
+
+    std::optional<uint32_t> FreeListAllocator::allocate(uint32_t size) {
+        if (size == 0) {
+            return {};
+        }
+
+        for (auto it = free_blocks_.begin(); it != free_blocks_.end(); it++) {
+            if (it->size < size) {
+                continue;
+            }
+
+            const uint32_t offset = it->offset;
+            if (it->size == size) {
+                free_blocks_.erase(it);
+            } else {
+                it->offset += size;
+                it->size -= size;
+            }
+
+            free_size_ -= size;
+            return offset;
+        }
+
+        return {};
+    }
+
+    void FreeListAllocator::free(uint32_t offset, uint32_t size) {
+        if (size == 0) {
+            return;
+        }
+        assert(offset + size <= capacity_ && "Freeing a range outside of the allocator");
+
+        auto next = std::lower_bound(free_blocks_.begin(), free_blocks_.end(), offset,
+                                     [](const Block& block, uint32_t value) { return block.offset < value; });
+
+        assert((next == free_blocks_.end() || offset + size <= next->offset) && "Freed range overlaps a free block");
+        assert((next == free_blocks_.begin() || std::prev(next)->offset + std::prev(next)->size <= offset) &&
+               "Freed range overlaps a free block");
+
+        free_size_ += size;
+
+        const bool merges_prev = next != free_blocks_.begin() && std::prev(next)->offset + std::prev(next)->size == offset;
+        const bool merges_next = next != free_blocks_.end() && offset + size == next->offset;
+
+        if (merges_prev && merges_next) {
+            std::prev(next)->size += size + next->size;
+            free_blocks_.erase(next);
+        } else if (merges_prev) {
+            std::prev(next)->size += size;
+        } else if (merges_next) {
+            next->offset = offset;
+            next->size += size;
+        } else {
+            free_blocks_.insert(next, {.offset = offset, .size = size});
+        }
+    }
+
+} // namespace leper
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace leper {
+
+    // Hands out ranges of a fixed size space, the memory itself is owned by the caller
+    // Free ranges are kept sorted and merged with their neighbours when released
+    class FreeListAllocator {
+      public:
+        explicit FreeListAllocator(uint32_t capacity);
+
+        // First fit, returns the offset of the range
+        std::optional<uint32_t> allocate(uint32_t size);
+        void free(uint32_t offset, uint32_t size);
+
+        uint32_t get_capacity() const { return capacity_; }
+        uint32_t get_free_size() const { return free_size_; }
+        size_t get_free_block_count() const { return free_blocks_.size(); }
+
+      private:
+        struct Block {
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        std::vector<Block> free_blocks_;
+        uint32_t capacity_;
+        uint32_t free_size_;
+    };
+
+} // namespace leper
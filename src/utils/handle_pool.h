@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "leper/leper_common_types.h"
+
+namespace leper {
+
+    // Dense storage addressed by generational handles
+    // Removing an element bumps the generation of its slot, so stale handles resolve to nullptr
+    template <typename T, typename Tag>
+    class HandlePool {
+      public:
+        Handle<Tag> insert(T value) {
+            uint32_t index;
+            if (!free_indices_.empty()) {
+                index = free_indices_.back();
+                free_indices_.pop_back();
+            } else {
+                index = static_cast<uint32_t>(slots_.size());
+                slots_.push_back({});
+            }
+
+            Slot& slot = slots_[index];
+            slot.value.emplace(std::move(value));
+            size_++;
+
+            return {.index = index, .generation = slot.generation};
+        }
+
+        // Returns false for stale or invalid handles
+        bool remove(Handle<Tag> handle) {
+            if (!get(handle)) {
+                return false;
+            }
+
+            Slot& slot = slots_[handle.index];
+            slot.value.reset();
+            // Skips 0 when wrapping around, it marks invalid handles
+            slot.generation = slot.generation == UINT32_MAX ? 1 : slot.generation + 1;
+            free_indices_.push_back(handle.index);
+            size_--;
+            return true;
+        }
+
+        T* get(Handle<Tag> handle) {
+            if (handle.index >= slots_.size()) {
+                return nullptr;
+            }
+            Slot& slot = slots_[handle.index];
+            return slot.value.has_value() && slot.generation == handle.generation ? &slot.value.value() : nullptr;
+        }
+
+        const T* get(Handle<Tag> handle) const {
+            return const_cast<HandlePool*>(this)->get(handle);
+        }
+
+        bool contains(Handle<Tag> handle) const { return get(handle) != nullptr; }
+
+        template <typename Fn>
+        void for_each(Fn&& fn) {
+            for (Slot& slot : slots_) {
+                if (slot.value.has_value()) {
+                    fn(slot.value.value());
+                }
+            }
+        }
+
+        size_t size() const { return size_; }
+
+      private:
+        struct Slot {
+            // Empty while the slot is free
+            std::optional<T> value;
+            uint32_t generation = 1;
+        };
+
+        std::vector<Slot> slots_;
+        std::vector<uint32_t> free_indices_;
+        size_t size_ = 0;
+    };
+
+} // namespace leper
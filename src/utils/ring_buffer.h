@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+
+namespace leper {
+
+    // Fixed capacity FIFO for a single thread. Pushing to a full ring overwrites its oldest element
+    template <typename T, size_t Capacity>
+    class RingBuffer {
+        static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+      public:
+        void push(const T& value) {
+            slots_[tail_ & (Capacity - 1)] = value;
+            tail_++;
+            if (tail_ - head_ > Capacity) {
+                head_++;
+            }
+        }
+
+        void pop_front() {
+            assert(!empty() && "Popping an empty ring");
+            head_++;
+        }
+
+        const T& front() const {
+            assert(!empty() && "Empty ring has no front");
+            return slots_[head_ & (Capacity - 1)];
+        }
+
+        // 0 is the oldest element
+        const T& operator[](size_t index) const {
+            assert(index < size() && "Ring index out of range");
+            return slots_[(head_ + index) & (Capacity - 1)];
+        }
+
+        size_t size() const { return tail_ - head_; }
+        bool empty() const { return tail_ == head_; }
+        void clear() { head_ = tail_; }
+
+      private:
+        std::array<T, Capacity> slots_ = {};
+        size_t head_ = 0;
+        size_t tail_ = 0;
+    };
+
+} // namespace leper
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace leper {
+
+    // Bounded lock-free ring between exactly one producer and one consumer thread.
+    // The blocking calls wait on the indices themselves, without a mutex
+    template <typename T, size_t Capacity>
+    class SpscQueue {
+        static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+      public:
+        // Producer only, fails when full
+        bool try_push(const T& value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+
+            slots_[tail & (Capacity - 1)] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            tail_.notify_one();
+            return true;
+        }
+
+        // Producer only, waits for the consumer while full
+        void push(const T& value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            size_t head = head_.load(std::memory_order_acquire);
+            while (tail - head == Capacity) {
+                head_.wait(head, std::memory_order_acquire);
+                head = head_.load(std::memory_order_acquire);
+            }
+
+            slots_[tail & (Capacity - 1)] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            tail_.notify_one();
+        }
+
+        // Consumer only, fails when empty
+        bool try_pop(T& value) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (tail_.load(std::memory_order_acquire) == head) {
+                return false;
+            }
+
+            value = slots_[head & (Capacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            head_.notify_one();
+            return true;
+        }
+
+        // Consumer only, waits for the producer while empty
+        T pop() {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            size_t tail = tail_.load(std::memory_order_acquire);
+            while (tail == head) {
+                tail_.wait(tail, std::memory_order_acquire);
+                tail = tail_.load(std::memory_order_acquire);
+            }
+
+            T value = slots_[head & (Capacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            head_.notify_one();
+            return value;
+        }
+
+      private:
+        // Separate cache lines, each index is only written by one side
+        alignas(64) std::atomic<size_t> head_ = 0;
+        alignas(64) std::atomic<size_t> tail_ = 0;
+        alignas(64) std::array<T, Capacity> slots_ = {};
+    };
+
+} // namespace leper
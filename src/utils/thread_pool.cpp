@@ -0,0 +1,106 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace leper {
+
+    ThreadPool::ThreadPool(size_t worker_count) {
+        if (worker_count == 0) {
+            const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+            worker_count = hardware_threads - 1;
+        }
+
+        workers_.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; i++) {
+            workers_.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        work_available_.notify_all();
+
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run(size_t count, size_t grain, ChunkFn fn, void* context) {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+
+        // Not worth waking anybody up
+        if (workers_.empty() || count <= grain) {
+            fn(context, 0, count);
+            return;
+        }
+
+        std::lock_guard loop_lock(loop_mutex_);
+        {
+            // Workers that woke up too late for the previous loop may still be on their way out
+            std::unique_lock lock(mutex_);
+            work_done_.wait(lock, [this] { return active_workers_ == 0; });
+
+            fn_ = fn;
+            context_ = context;
+            count_ = count;
+            grain_ = grain;
+            chunk_count_ = (count + grain - 1) / grain;
+            next_chunk_ = 0;
+            completed_chunks_ = 0;
+            generation_++;
+        }
+        work_available_.notify_all();
+
+        run_chunks();
+
+        // Late workers may still be reading the loop description, wait for them too
+        std::unique_lock lock(mutex_);
+        work_done_.wait(lock, [this] { return completed_chunks_ == chunk_count_ && active_workers_ == 0; });
+    }
+
+    void ThreadPool::run_chunks() {
+        while (true) {
+            const size_t chunk = next_chunk_.fetch_add(1);
+            if (chunk >= chunk_count_) {
+                return;
+            }
+
+            const size_t begin = chunk * grain_;
+            const size_t end = std::min(begin + grain_, count_);
+            fn_(context_, begin, end);
+
+            completed_chunks_.fetch_add(1);
+        }
+    }
+
+    void ThreadPool::worker_loop() {
+        uint64_t seen_generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock lock(mutex_);
+                work_available_.wait(lock, [&] { return stopping_ || generation_ != seen_generation; });
+                if (stopping_) {
+                    return;
+                }
+                seen_generation = generation_;
+                active_workers_++;
+            }
+
+            run_chunks();
+
+            {
+                std::lock_guard lock(mutex_);
+                active_workers_--;
+            }
+            work_done_.notify_all();
+        }
+    }
+
+} // namespace leper
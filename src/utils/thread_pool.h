@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace leper {
+
+    // Fixed set of workers running blocking parallel loops. The calling thread
+    // takes part in the work, and nothing is allocated per call
+    class ThreadPool {
+      public:
+        // 0 picks one worker per hardware thread, minus the caller
+        explicit ThreadPool(size_t worker_count = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Calls fn(begin, end) over [0, count) in chunks of `grain` items and returns once all are done.
+        // Loops started from different threads run one after the other.
+        // Not reentrant: fn must not call parallel_for on the same pool
+        template <typename Fn>
+        void parallel_for(size_t count, size_t grain, Fn&& fn) {
+            using Function = std::remove_reference_t<Fn>;
+            run(
+                count, grain,
+                [](void* context, size_t begin, size_t end) { (*static_cast<Function*>(context))(begin, end); },
+                const_cast<void*>(static_cast<const void*>(&fn)));
+        }
+
+        // Workers plus the calling thread
+        size_t get_thread_count() const { return workers_.size() + 1; }
+
+      private:
+        using ChunkFn = void (*)(void* context, size_t begin, size_t end);
+
+        void run(size_t count, size_t grain, ChunkFn fn, void* context);
+        void run_chunks();
+        void worker_loop();
+
+        std::vector<std::thread> workers_;
+
+        // Held by the caller for a whole loop
+        std::mutex loop_mutex_;
+        std::mutex mutex_;
+        std::condition_variable work_available_;
+        std::condition_variable work_done_;
+        uint64_t generation_ = 0;
+        size_t active_workers_ = 0;
+        bool stopping_ = false;
+
+        // Current loop, only modified while no worker is active
+        ChunkFn fn_ = nullptr;
+        void* context_ = nullptr;
+        size_t count_ = 0;
+        size_t grain_ = 1;
+        size_t chunk_count_ = 0;
+        std::atomic<size_t> next_chunk_ = 0;
+        std::atomic<size_t> completed_chunks_ = 0;
+    };
+
+} // namespace leper